@@ -17,13 +17,19 @@ SQLITE_EXTENSION_INIT1
 #include <stdarg.h>
 #include <ctype.h>
 #include <stdio.h>
-#include <iomanip>
+#include <math.h>
+#include <algorithm>
 #include <sys/time.h>
+#include <map>
 #include <memory>
+#include <mutex>
 
+#include "parquet_bloom.h"
 #include "parquet_table.h"
 #include "parquet_cursor.h"
 #include "parquet_filter.h"
+#include "parquet_metadata.h"
+#include "parquet_reader_pool.h"
 
 //#define DEBUG
 
@@ -50,6 +56,12 @@ typedef struct sqlite3_vtab_parquet {
   sqlite3_vtab base;              /* Base class.  Must be first */
   ParquetTable* table;
   sqlite3* db;
+  // Reads and writes of the _rowgroups shadow table, prepared on first use
+  sqlite3_stmt* memoLookup;
+  sqlite3_stmt* memoStore;
+  sqlite3_stmt* memoObserved;
+  // Set once entries for other versions of the files have been cleared out
+  int memoChecked;
 } sqlite3_vtab_parquet;
 
 
@@ -57,10 +69,49 @@ typedef struct sqlite3_vtab_parquet {
 typedef struct sqlite3_vtab_cursor_parquet {
   sqlite3_vtab_cursor base;       /* Base class.  Must be first */
   ParquetCursor* cursor;
+  // Set while the scan's findings haven't been written to _rowgroups
+  int memoPending;
 } sqlite3_vtab_cursor_parquet;
 
+// The tables each connection has connected, so SQL functions can find them
+// by name. Names are keyed in lower case, as SQLite matches them.
+static std::mutex connectedTablesMutex;
+static std::map<std::pair<sqlite3*, std::string>, ParquetTable*> connectedTables;
+
+static std::string lowerCase(std::string s) {
+  for(unsigned int i = 0; i < s.size(); i++)
+    s[i] = tolower((unsigned char)s[i]);
+  return s;
+}
+
+static void registerTable(sqlite3* db, ParquetTable* table) {
+  std::lock_guard<std::mutex> lock(connectedTablesMutex);
+  connectedTables[std::make_pair(db, lowerCase(table->getTableName()))] = table;
+}
+
+static void unregisterTable(sqlite3* db, ParquetTable* table) {
+  std::lock_guard<std::mutex> lock(connectedTablesMutex);
+  auto it = connectedTables.find(std::make_pair(db, lowerCase(table->getTableName())));
+  if(it != connectedTables.end() && it->second == table)
+    connectedTables.erase(it);
+}
+
+static ParquetTable* findTable(sqlite3* db, const std::string& name) {
+  std::lock_guard<std::mutex> lock(connectedTablesMutex);
+  auto it = connectedTables.find(std::make_pair(db, lowerCase(name)));
+  return it == connectedTables.end() ? NULL : it->second;
+}
+
+static void finalizeMemoStatements(sqlite3_vtab_parquet* p) {
+  sqlite3_finalize(p->memoLookup);
+  sqlite3_finalize(p->memoStore);
+  sqlite3_finalize(p->memoObserved);
+  p->memoLookup = p->memoStore = p->memoObserved = NULL;
+}
+
 static int parquetDestroy(sqlite3_vtab *pVtab) {
   sqlite3_vtab_parquet *p = (sqlite3_vtab_parquet*)pVtab;
+  finalizeMemoStatements(p);
 
   // Clean up our shadow table. This is useful if the user has recreated
   // the parquet file, and our mappings would now be invalid.
@@ -71,6 +122,14 @@ static int parquetDestroy(sqlite3_vtab *pVtab) {
   if(rv != 0)
     return rv;
 
+  drop = "DROP TABLE IF EXISTS _";
+  drop.append(p->table->getTableName());
+  drop.append("_blooms");
+  rv = sqlite3_exec(p->db, drop.data(), 0, 0, 0);
+  if(rv != 0)
+    return rv;
+
+  unregisterTable(p->db, p->table);
   return SQLITE_OK;
 }
 
@@ -79,6 +138,8 @@ static int parquetDestroy(sqlite3_vtab *pVtab) {
 */
 static int parquetDisconnect(sqlite3_vtab *pVtab){
   sqlite3_vtab_parquet *p = (sqlite3_vtab_parquet*)pVtab;
+  finalizeMemoStatements(p);
+  unregisterTable(p->db, p->table);
   delete p->table;
   sqlite3_free(p);
   return SQLITE_OK;
@@ -93,8 +154,8 @@ static int parquetConnect(
   char **pzErr
 ){
   try {
-    if(argc != 4 || strlen(argv[3]) < 2) {
-      *pzErr = sqlite3_mprintf("must provide exactly one argument, the path to a parquet file");
+    if(argc < 4 || strlen(argv[3]) < 2) {
+      *pzErr = sqlite3_mprintf("must provide the path to a parquet file, directory or glob, optionally followed by options");
       return SQLITE_ERROR;
     }
 
@@ -108,7 +169,15 @@ static int parquetConnect(
     memset(vtab.get(), 0, sizeof(*vtab.get()));
 
     try {
-      std::unique_ptr<ParquetTable> table(new ParquetTable(fname, tableName));
+      ParquetTableOptions options;
+      for(int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg.length() >= 2 && arg[0] == '\'' && arg[arg.length() - 1] == '\'')
+          arg = arg.substr(1, arg.length() - 2);
+        options.parse(arg);
+      }
+
+      std::unique_ptr<ParquetTable> table(new ParquetTable(fname, tableName, options));
 
       std::string create = table->CreateStatement();
       int rc = sqlite3_declare_vtab(db, create.data());
@@ -117,10 +186,11 @@ static int parquetConnect(
 
       vtab->table = table.release();
       vtab->db = db;
+      registerTable(db, vtab->table);
       *ppVtab = (sqlite3_vtab*)vtab.release();
       return SQLITE_OK;
     } catch (const std::exception& e) {
-      *pzErr = sqlite3_mprintf(e.what());
+      *pzErr = sqlite3_mprintf("%s", e.what());
       return SQLITE_ERROR;
     }
   } catch(std::bad_alloc& ba) {
@@ -130,6 +200,31 @@ static int parquetConnect(
   }
 }
 
+// A shadow table from before entries were stamped with the version of the
+// files they're about can't be trusted, so drop it to start afresh
+static void dropUnstampedTable(sqlite3* db, const std::string& name) {
+  std::unique_ptr<char, void(*)(void*)> sql(sqlite3_mprintf(
+      "SELECT footer_hash FROM \"%w\"", name.c_str()), sqlite3_free);
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+
+  sqlite3_stmt* pStmt = NULL;
+  int rc = sqlite3_prepare_v2(db, sql.get(), -1, &pStmt, NULL);
+  sqlite3_finalize(pStmt);
+  if(rc == SQLITE_OK)
+    return;
+
+  sql.reset(sqlite3_mprintf("DROP TABLE IF EXISTS \"%w\"", name.c_str()));
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+  sqlite3_exec(db, sql.get(), 0, 0, 0);
+}
+
+// The _<table>_blooms shadow table's columns
+#define BLOOM_COLUMNS \
+  "col TEXT, rowgroup INTEGER, rows INTEGER, filter BLOB, " \
+  "size INTEGER, mtime INTEGER, footer_hash INTEGER, PRIMARY KEY(col, rowgroup)"
+
 /*
 ** The xConnect and xCreate methods do the same thing, but they must be
 ** different so that the virtual table is not an eponymous virtual table.
@@ -142,10 +237,14 @@ static int parquetCreate(
   char **pzErr
 ){
   try {
-    // Create shadow table for storing constraint -> rowid mappings
+    dropUnstampedTable(db, std::string("_") + argv[2] + "_rowgroups");
+    dropUnstampedTable(db, std::string("_") + argv[2] + "_blooms");
+
+    // Create shadow table for storing constraint -> rowid mappings, for each
+    // clause and for each set of clauses queried together
     std::string create = "CREATE TABLE IF NOT EXISTS _";
     create.append(argv[2]);
-    create.append("_rowgroups(clause TEXT, estimate BLOB, actual BLOB)");
+    create.append("_rowgroups(clause TEXT, estimate BLOB, actual BLOB, size INTEGER, mtime INTEGER, footer_hash INTEGER)");
     int rv = sqlite3_exec(db, create.data(), 0, 0, 0);
     if(rv != 0)
       return rv;
@@ -157,59 +256,170 @@ static int parquetCreate(
     create.append("_rowgroups(clause)");
     rv = sqlite3_exec(db, create.data(), 0, 0, 0);
 
+    // And for bloom filters built by parquet_build_bloom
+    create = "CREATE TABLE IF NOT EXISTS _";
+    create.append(argv[2]);
+    create.append("_blooms(" BLOOM_COLUMNS ")");
+    rv = sqlite3_exec(db, create.data(), 0, 0, 0);
+
     return parquetConnect(db, pAux, argc, argv, ppVtab, pzErr);
   } catch (std::bad_alloc& ba) {
     return SQLITE_NOMEM;
   }
 }
 
-std::string quoteBlob(const std::vector<unsigned char>& bytes) {
-  std::ostringstream ss;
-  ss << "X'" << std::hex;
-  for(unsigned int i = 0; i < bytes.size(); i++) {
-    ss << std::setfill('0') << std::setw(2) << (unsigned int)(unsigned char)bytes[i];
-  }
-  ss << "'";
+// Prepare a statement on the vtab's shadow tables once, keeping it for
+// later scans. NULL if it can't be, eg the shadow table was dropped.
+static sqlite3_stmt* prepareMemoStatement(sqlite3_vtab_parquet* p, sqlite3_stmt** stmt, const char* format) {
+  if(*stmt != NULL)
+    return *stmt;
+
+  std::unique_ptr<char, void(*)(void*)> sql(
+      sqlite3_mprintf(format, p->table->getTableName().c_str()), sqlite3_free);
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
 
-  return ss.str();
+  sqlite3_prepare_v3(p->db, sql.get(), -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+  return *stmt;
 }
 
-void persistConstraints(sqlite3* db, ParquetCursor* cursor) {
-  for(unsigned int i = 0; i < cursor->getNumConstraints(); i++) {
-    const Constraint& constraint = cursor->getConstraint(i);
-    const std::vector<unsigned char>& estimated = constraint.bitmap.estimatedMembership;
-    const std::vector<unsigned char>& actual = constraint.bitmap.actualMembership;
-    if(estimated == actual) {
-      continue;
-    }
-    std::string desc = constraint.describe();
+// Bind the table's fingerprint to three consecutive parameters
+static void bindFingerprint(sqlite3_stmt* stmt, int first, ParquetTable* table) {
+  const TableFingerprint& fingerprint = table->getFingerprint();
+  sqlite3_bind_int64(stmt, first, fingerprint.size);
+  sqlite3_bind_int64(stmt, first + 1, fingerprint.mtime);
+  sqlite3_bind_int64(stmt, first + 2, fingerprint.footerHash);
+}
+
+// Clear out entries about other versions of the files, once per connection
+static void purgeStaleMemo(sqlite3_vtab_parquet* p) {
+  if(p->memoChecked)
+    return;
+  p->memoChecked = 1;
 
-    std::string estimatedStr = quoteBlob(estimated);
-    std::string actualStr = quoteBlob(actual);
+  std::unique_ptr<char, void(*)(void*)> sql(sqlite3_mprintf(
+      "DELETE FROM \"_%w_rowgroups\" WHERE size IS NOT ?1 OR mtime IS NOT ?2 OR footer_hash IS NOT ?3",
+      p->table->getTableName().c_str()), sqlite3_free);
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
 
-    // This is only advisory, so ignore failures.
-    char* sql = sqlite3_mprintf(
-        "INSERT OR REPLACE INTO _%s_rowgroups(clause, estimate, actual) VALUES ('%q', %s, %s)",
-        cursor->getTable()->getTableName().c_str(),
-        desc.c_str(),
-        estimatedStr.c_str(),
-        actualStr.c_str());
+  sqlite3_stmt* pStmt = NULL;
+  sqlite3_prepare_v2(p->db, sql.get(), -1, &pStmt, NULL);
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> stmt(pStmt, sqlite3_finalize);
+  if(pStmt == NULL)
+    return;
 
+  bindFingerprint(pStmt, 1, p->table);
+  sqlite3_step(pStmt);
+}
 
-    if(sql == NULL)
-      return;
+// The memo's key for a scan's constraints taken together, or "" if there
+// are fewer than two distinct clauses, which the per-clause entries cover.
+// Clauses are sorted, so the order they're written in doesn't matter. As
+// describe() quotes names and values, a value can't pass for " AND ".
+static std::string describeConjunction(const std::vector<Constraint>& constraints) {
+  std::vector<std::string> clauses;
+  for(unsigned int i = 0; i < constraints.size(); i++)
+    clauses.push_back(constraints[i].describe());
+  std::sort(clauses.begin(), clauses.end());
+  clauses.erase(std::unique(clauses.begin(), clauses.end()), clauses.end());
+  if(clauses.size() < 2)
+    return "";
+
+  std::string rv;
+  for(unsigned int i = 0; i < clauses.size(); i++) {
+    if(i > 0)
+      rv.append(" AND ");
+    rv.append("(");
+    rv.append(clauses[i]);
+    rv.append(")");
+  }
+  return rv;
+}
+
+static void storeMemo(
+    sqlite3_stmt* stmt,
+    const std::string& clause,
+    const RowGroupBitmap& bitmap) {
+  sqlite3_bind_text(stmt, 1, clause.data(), clause.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, &bitmap.estimatedMembership[0], bitmap.estimatedMembership.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 3, &bitmap.actualMembership[0], bitmap.actualMembership.size(), SQLITE_STATIC);
+  sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+}
+
+// Write what the scan learnt about which row groups its constraints match,
+// alone and together, for those where it differs from what was expected,
+// all in one transaction.
+void persistConstraints(sqlite3_vtab_parquet* p, ParquetCursor* cursor) {
+  std::vector<unsigned int> changed;
+  for(unsigned int i = 0; i < cursor->getNumConstraints(); i++) {
+    const Constraint& constraint = cursor->getConstraint(i);
+    if(constraint.bitmap.estimatedMembership != constraint.bitmap.actualMembership)
+      changed.push_back(i);
+  }
 
-    sqlite3_exec(db, sql, 0, 0, 0);
-    sqlite3_free(sql);
+  std::string conjunction = describeConjunction(cursor->getConstraints());
+  const RowGroupBitmap& conjunctionBitmap = cursor->getConjunction();
+  bool conjunctionChanged = !conjunction.empty() &&
+    conjunctionBitmap.estimatedMembership != conjunctionBitmap.actualMembership;
+  if(changed.empty() && !conjunctionChanged)
+    return;
+
+  purgeStaleMemo(p);
+  sqlite3_stmt* stmt = prepareMemoStatement(p, &p->memoStore,
+      "INSERT OR REPLACE INTO \"_%w_rowgroups\"(clause, estimate, actual, size, mtime, footer_hash) "
+      "VALUES (?, ?, ?, ?, ?, ?)");
+  if(stmt == NULL)
+    return;
+
+  // This is only advisory, so ignore failures.
+  if(sqlite3_exec(p->db, "SAVEPOINT parquet_memo", 0, 0, 0) != SQLITE_OK)
+    return;
+
+  bindFingerprint(stmt, 4, p->table);
+  for(unsigned int i = 0; i < changed.size(); i++)
+    storeMemo(stmt, cursor->getConstraint(changed[i]).describe(), cursor->getConstraint(changed[i]).bitmap);
+  if(conjunctionChanged)
+    storeMemo(stmt, conjunction, conjunctionBitmap);
+  sqlite3_clear_bindings(stmt);
+
+  if(sqlite3_exec(p->db, "RELEASE parquet_memo", 0, 0, 0) != SQLITE_OK) {
+    // Don't leave the savepoint, and perhaps a transaction, open
+    sqlite3_exec(p->db, "ROLLBACK TO parquet_memo", 0, 0, 0);
+    sqlite3_exec(p->db, "RELEASE parquet_memo", 0, 0, 0);
   }
 }
 
+// Write the memo for the cursor's scan, if it hasn't been yet.
+static void flushMemo(sqlite3_vtab_cursor_parquet* cur) {
+  if(!cur->memoPending)
+    return;
+
+  cur->memoPending = 0;
+  persistConstraints((sqlite3_vtab_parquet*)cur->base.pVtab, cur->cursor);
+}
+
 
 /*
 ** Destructor for a sqlite3_vtab_cursor_parquet.
 */
 static int parquetClose(sqlite3_vtab_cursor *cur){
   sqlite3_vtab_cursor_parquet* vtab_cursor_parquet = (sqlite3_vtab_cursor_parquet*)cur;
+#ifdef DEBUG
+  ParquetCursor* cursor = vtab_cursor_parquet->cursor;
+  printf("xClose: used %u of %u columns, read %lld column chunks (%lld bytes)\n",
+      cursor->getNumColumnsUsed(),
+      cursor->getTable()->getNumColumns(),
+      (long long)cursor->getColumnChunksRead(),
+      (long long)cursor->getCompressedBytesRead());
+#endif
+  // A scan cut short by a LIMIT or an error still learnt something about
+  // the row groups it finished
+  try {
+    flushMemo(vtab_cursor_parquet);
+  } catch(std::bad_alloc& ba) {
+  }
   vtab_cursor_parquet->cursor->close();
   delete vtab_cursor_parquet->cursor;
   sqlite3_free(cur);
@@ -290,10 +500,18 @@ static int parquetColumn(
         case parquet::Type::BYTE_ARRAY:
         {
           parquet::ByteArray* rv = cursor->getByteArray(col);
+          // Dictionary entries are shared with SQLite rather than copied
+          const char* stable = cursor->getStableValue(col, *rv);
           if(cursor->getLogicalType(col) == parquet::LogicalType::UTF8) {
-            sqlite3_result_text(ctx, (const char*)rv->ptr, rv->len, SQLITE_TRANSIENT);
+            if(stable != NULL)
+              sqlite3_result_text(ctx, stable, StableDictionary::hasNul(stable) ? (int)rv->len : -1, releaseStableValue);
+            else
+              sqlite3_result_text(ctx, (const char*)rv->ptr, rv->len, SQLITE_TRANSIENT);
           } else {
-            sqlite3_result_blob(ctx, (void*)rv->ptr, rv->len, SQLITE_TRANSIENT);
+            if(stable != NULL)
+              sqlite3_result_blob(ctx, stable, rv->len, releaseStableValue);
+            else
+              sqlite3_result_blob(ctx, (void*)rv->ptr, rv->len, SQLITE_TRANSIENT);
           }
           break;
         }
@@ -309,7 +527,11 @@ static int parquetColumn(
         case parquet::Type::FIXED_LEN_BYTE_ARRAY:
         {
           parquet::ByteArray* rv = cursor->getByteArray(col);
-          sqlite3_result_blob(ctx, (void*)rv->ptr, rv->len, SQLITE_TRANSIENT);
+          const char* stable = cursor->getStableValue(col, *rv);
+          if(stable != NULL)
+            sqlite3_result_blob(ctx, stable, rv->len, releaseStableValue);
+          else
+            sqlite3_result_blob(ctx, (void*)rv->ptr, rv->len, SQLITE_TRANSIENT);
           break;
         }
         default:
@@ -347,9 +569,11 @@ static int parquetRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
 static int parquetEof(sqlite3_vtab_cursor *cur){
   ParquetCursor* cursor = ((sqlite3_vtab_cursor_parquet*)cur)->cursor;
   if(cursor->eof()) {
-    sqlite3_vtab_cursor_parquet* vtab_cursor_parquet = (sqlite3_vtab_cursor_parquet*)cur;
-    sqlite3_vtab_parquet* vtab_parquet = (sqlite3_vtab_parquet*)(vtab_cursor_parquet->base.pVtab);
-    persistConstraints(vtab_parquet->db, cursor);
+    try {
+      flushMemo((sqlite3_vtab_cursor_parquet*)cur);
+    } catch(std::bad_alloc& ba) {
+      // It's only advisory
+    }
     return 1;
   }
   return 0;
@@ -386,6 +610,12 @@ const char* opName(int op) {
       return "IS NULL";
     case SQLITE_INDEX_CONSTRAINT_IS:
       return "IS";
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+    case SQLITE_INDEX_CONSTRAINT_LIMIT:
+      return "LIMIT";
+    case SQLITE_INDEX_CONSTRAINT_OFFSET:
+      return "OFFSET";
+#endif
     default:
       return "unknown";
   }
@@ -393,10 +623,10 @@ const char* opName(int op) {
 
 void debugConstraints(sqlite3_index_info *pIdxInfo, ParquetTable *table, int argc, sqlite3_value** argv) {
   printf("debugConstraints, argc=%d\n", argc);
-  int j = 0;
   for(int i = 0; i < pIdxInfo->nConstraint; i++) {
     std::string valueStr = "?";
-    if(argv != NULL && pIdxInfo->aConstraint[i].usable) {
+    int j = pIdxInfo->aConstraintUsage[i].argvIndex - 1;
+    if(argv != NULL && j >= 0) {
       int type = sqlite3_value_type(argv[j]);
       switch(type) {
         case SQLITE_INTEGER:
@@ -437,7 +667,6 @@ void debugConstraints(sqlite3_index_info *pIdxInfo, ParquetTable *table, int arg
           break;
         }
       }
-      j++;
     }
     printf("  constraint %d: col %s %s %s, usable %d\n",
         i,
@@ -482,37 +711,493 @@ ConstraintOperator constraintOperatorFromSqlite(int op) {
   throw std::invalid_argument(ss.str());
 }
 
-std::vector<unsigned char> getRowGroupsForClause(sqlite3* db, std::string table, std::string clause) {
+// How SQLite compares a column's values with other values, from the type
+// CreateStatement declared for it.
+enum ColumnAffinity {
+  NoAffinity,
+  IntegerAffinity,
+  RealAffinity,
+  TextAffinity
+};
+
+static ColumnAffinity getColumnAffinity(ParquetTable* table, int col) {
+  if(col == -1)
+    return IntegerAffinity;
+
+  if(table->isPartitionColumn(col))
+    return TextAffinity;
+
+  const parquet::ColumnDescriptor* descr = table->getSchema()->Column(col);
+  switch(descr->physical_type()) {
+    case parquet::Type::BOOLEAN:
+    case parquet::Type::INT32:
+    case parquet::Type::INT64:
+    case parquet::Type::INT96:
+      return IntegerAffinity;
+    case parquet::Type::FLOAT:
+    case parquet::Type::DOUBLE:
+      return RealAffinity;
+    case parquet::Type::BYTE_ARRAY:
+      if(descr->logical_type() == parquet::LogicalType::UTF8)
+        return TextAffinity;
+      return NoAffinity;
+    default:
+      return NoAffinity;
+  }
+}
+
+static bool isLimitOrOffset(int op) {
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+  return op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET;
+#else
+  return false;
+#endif
+}
+
+static bool isComparison(ConstraintOperator op) {
+  switch(op) {
+    case Equal:
+    case NotEqual:
+    case GreaterThan:
+    case GreaterThanOrEqual:
+    case LessThan:
+    case LessThanOrEqual:
+    case Is:
+    case IsNot:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+** Whether constraint i's value is known while planning, as a literal's is,
+** rather than coming from another table.
+*/
+static bool hasKnownValue(sqlite3_index_info* pIdxInfo, int i) {
+#if SQLITE_VERSION_NUMBER >= 3038000
+  // The extension may be loaded into an older SQLite than it was built with
+  if(sqlite3_libversion_number() < 3038000)
+    return false;
+
+  sqlite3_value* value = NULL;
+  return sqlite3_vtab_rhs_value(pIdxInfo, i, &value) == SQLITE_OK && value != NULL;
+#else
+  return false;
+#endif
+}
+
+/*
+** Whether the cursor's filters decide a constraint exactly as SQLite would,
+** so that SQLite needn't check it again. LIKE and GLOB are only used to
+** prune, and blob columns are only filtered by their statistics.
+*/
+static bool isExactConstraint(ParquetTable* table, sqlite3_index_info* pIdxInfo, int i) {
+  int op = pIdxInfo->aConstraint[i].op;
+  if(op == SQLITE_INDEX_CONSTRAINT_ISNULL || op == SQLITE_INDEX_CONSTRAINT_ISNOTNULL)
+    return true;
+
+  if(op != SQLITE_INDEX_CONSTRAINT_EQ &&
+      op != SQLITE_INDEX_CONSTRAINT_NE &&
+      op != SQLITE_INDEX_CONSTRAINT_GT &&
+      op != SQLITE_INDEX_CONSTRAINT_GE &&
+      op != SQLITE_INDEX_CONSTRAINT_LT &&
+      op != SQLITE_INDEX_CONSTRAINT_LE &&
+      op != SQLITE_INDEX_CONSTRAINT_IS &&
+      op != SQLITE_INDEX_CONSTRAINT_ISNOT)
+    return false;
+
+  switch(getColumnAffinity(table, pIdxInfo->aConstraint[i].iColumn)) {
+    case IntegerAffinity:
+    case RealAffinity:
+      return true;
+    case TextAffinity:
+    {
+      // Text is compared with memcmp
+      const char* collation = sqlite3_vtab_collation(pIdxInfo, i);
+      if(collation != NULL && sqlite3_stricmp(collation, "BINARY") != 0)
+        return false;
+
+      // Numbers are compared as text only if the value has no affinity of
+      // its own, as a literal doesn't. In a join like text_col = t.int_col,
+      // SQLite takes '05' = 5 to be true.
+      return hasKnownValue(pIdxInfo, i);
+    }
+    default:
+      return false;
+  }
+}
+
+// Every non-null value in the column compares less than the constraint's
+// value (or, if columnIsLess is false, greater than it), as when comparing
+// a number with text. Rewrite the constraint as the null test it's
+// equivalent to. For =, <>, IS and IS NOT, it's enough that no value in the
+// column can equal the constraint's value.
+//
+// Returns false if every row satisfies the constraint.
+static bool rewriteAsNullTest(ConstraintOperator& op, ValueType& type, bool columnIsLess) {
+  type = Null;
+  switch(op) {
+    case IsNot:
+      return false;
+    case NotEqual:
+      op = IsNotNull;
+      break;
+    case LessThan:
+    case LessThanOrEqual:
+      // A comparison with NULL matches nothing
+      op = columnIsLess ? IsNotNull : Equal;
+      break;
+    case GreaterThan:
+    case GreaterThanOrEqual:
+      op = columnIsLess ? Equal : IsNotNull;
+      break;
+    default:
+      op = Equal;
+      break;
+  }
+  return true;
+}
+
+/*
+** Rewrite a comparison so that its value has the same type as the column's
+** values, which is all the cursor's filters know how to compare. The result
+** must select exactly the rows SQLite would, as SQLite may not check them.
+**
+** Returns false if every row satisfies the constraint.
+*/
+static bool coerceConstraint(
+    ColumnAffinity affinity,
+    ConstraintOperator& op,
+    ValueType& type,
+    int64_t& intValue,
+    double& doubleValue) {
+  if(type == Null) {
+    if(op == Is)
+      op = IsNull;
+    else if(op == IsNot)
+      op = IsNotNull;
+    return true;
+  }
+
+  if(!isComparison(op))
+    return true;
+
+  // SQLite orders NULL < numbers < text < blobs
+  switch(affinity) {
+    case IntegerAffinity:
+      if(type == Text || type == Blob)
+        return rewriteAsNullTest(op, type, true);
+
+      if(type == Double) {
+        if(!(doubleValue >= -9223372036854775808.0 && doubleValue < 9223372036854775808.0))
+          return rewriteAsNullTest(op, type, doubleValue > 0);
+
+        double whole = floor(doubleValue);
+        if(whole != doubleValue) {
+          // x > 2.5 iff x > 2; x < 2.5 iff x <= 2
+          if(op == GreaterThan || op == GreaterThanOrEqual)
+            op = GreaterThan;
+          else if(op == LessThan || op == LessThanOrEqual)
+            op = LessThanOrEqual;
+          else
+            return rewriteAsNullTest(op, type, true);
+        }
+        type = Integer;
+        intValue = (int64_t)whole;
+      }
+      return true;
+
+    case RealAffinity:
+      if(type == Text || type == Blob)
+        return rewriteAsNullTest(op, type, true);
+
+      if(type == Integer) {
+        double nearest = (double)intValue;
+        // long double holds any int64 exactly
+        long double exact = intValue;
+        if((long double)nearest != exact) {
+          // No double equals it, so compare with the doubles either side
+          if(op == GreaterThan || op == GreaterThanOrEqual) {
+            op = GreaterThanOrEqual;
+            if((long double)nearest < exact)
+              nearest = nextafter(nearest, INFINITY);
+          } else if(op == LessThan || op == LessThanOrEqual) {
+            op = LessThanOrEqual;
+            if((long double)nearest > exact)
+              nearest = nextafter(nearest, -INFINITY);
+          } else {
+            return rewriteAsNullTest(op, type, true);
+          }
+        }
+        type = Double;
+        doubleValue = nearest;
+      }
+      return true;
+
+    case TextAffinity:
+      // Numbers were converted to text when the value was read
+      if(type == Blob)
+        return rewriteAsNullTest(op, type, true);
+      return true;
+
+    default:
+      return true;
+  }
+}
+
+static bool isSupportedOperator(int op) {
+  try {
+    constraintOperatorFromSqlite(op);
+    return true;
+  } catch(std::invalid_argument& e) {
+    return false;
+  }
+}
+
+// The row groups a clause, or a conjunction of clauses, matched when last
+// scanned, or an empty vector if it hasn't been since the files changed.
+std::vector<unsigned char> getRowGroupsForClause(sqlite3_vtab_parquet* p, const std::string& clause) {
   std::vector<unsigned char> rv;
 
+  purgeStaleMemo(p);
+  sqlite3_stmt* stmt = prepareMemoStatement(p, &p->memoLookup,
+      "SELECT actual FROM \"_%w_rowgroups\" WHERE clause = ? AND size = ? AND mtime = ? AND footer_hash = ?");
+  if(stmt == NULL)
+    return rv;
+
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> reset(stmt, sqlite3_reset);
+  sqlite3_bind_text(stmt, 1, clause.data(), clause.size(), SQLITE_STATIC);
+  bindFingerprint(stmt, 2, p->table);
+  if(sqlite3_step(stmt) == SQLITE_ROW) {
+    int size = sqlite3_column_bytes(stmt, 0);
+    const unsigned char* blob = (const unsigned char*)sqlite3_column_blob(stmt, 0);
+    rv.assign(blob, blob + size);
+  }
+  return rv;
+}
+
+
+// The bloom filters parquet_build_bloom stored for a column, by row group,
+// or an empty vector if there are none. Filters stamped with another
+// version of the files are ignored, as are any whose row group's size
+// doesn't match.
+static std::vector<std::shared_ptr<BloomFilter>> getStoredBloomFilters(sqlite3* db, ParquetTable* table, int col) {
+  std::vector<std::shared_ptr<BloomFilter>> rv;
+
   std::unique_ptr<char, void(*)(void*)> sql(sqlite3_mprintf(
-      "SELECT actual FROM _%s_rowgroups WHERE clause = '%q'",
-      table.c_str(),
-      clause.c_str()), sqlite3_free);
+      "SELECT rowgroup, rows, filter FROM \"_%w_blooms\" "
+      "WHERE col = ?1 AND size = ?2 AND mtime = ?3 AND footer_hash = ?4",
+      table->getTableName().c_str()), sqlite3_free);
 
   if(sql.get() == NULL)
     return rv;
 
+  // Tables created before there were bloom filters don't have the table,
+  // and those from before they were stamped lack the columns
   sqlite3_stmt* pStmt = NULL;
   int rc = sqlite3_prepare_v2(db, sql.get(), -1, &pStmt, NULL);
   if(rc != 0)
     return rv;
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> stmt(pStmt, sqlite3_finalize);
+
+  sqlite3_bind_text(pStmt, 1, table->columnName(col).c_str(), -1, SQLITE_TRANSIENT);
+  bindFingerprint(pStmt, 2, table);
+
+  int numRowGroups = table->getNumRowGroups();
+  while(sqlite3_step(pStmt) == SQLITE_ROW) {
+    sqlite3_int64 group = sqlite3_column_int64(pStmt, 0);
+    sqlite3_int64 rows = sqlite3_column_int64(pStmt, 1);
+    int size = sqlite3_column_bytes(pStmt, 2);
+    const uint8_t* blob = (const uint8_t*)sqlite3_column_blob(pStmt, 2);
+    if(group < 0 || group >= numRowGroups ||
+        rows != table->getRowGroupStart(group + 1) - table->getRowGroupStart(group) ||
+        size == 0 || size % 32 != 0)
+      continue;
+
+    rv.resize(numRowGroups);
+    rv[group].reset(new BloomFilter(std::vector<uint8_t>(blob, blob + size)));
+  }
+  return rv;
+}
+
+// Give the table whatever bloom filters there are for a column, unless it
+// has them already: the file's own or, failing that, those stored by
+// parquet_build_bloom.
+static void loadBloomFilters(sqlite3* db, ParquetTable* table, int col) {
+  if(col == -1 || table->isPartitionColumn(col) || table->hasBloomFilters(col))
+    return;
+
+  std::vector<std::shared_ptr<BloomFilter>> filters = table->readBloomFilters(col);
+  if(filters.empty())
+    filters = getStoredBloomFilters(db, table, col);
+  table->setBloomFilters(col, filters);
+}
 
-  rc = sqlite3_step(pStmt);
-  if(rc == SQLITE_ROW) {
-    int size = sqlite3_column_bytes(pStmt, 0);
-    unsigned char* blob = (unsigned char*)sqlite3_column_blob(pStmt, 0);
-    // TODO: there is a memory leak here if we get a std::bad_alloc while populating rv;
-    // we fail to free pStmt
-    for(int i = 0; i < size; i++) {
-      rv.push_back(blob[i]);
+// The fraction of row groups that held rows for past constraints on column
+// with operator op, whatever their value, as recorded in the shadow table
+// for the files as they are now. Returns -1 if there's no history.
+static double getObservedRowGroupFraction(
+    sqlite3_vtab_parquet* p,
+    const std::string& column,
+    ConstraintOperator op,
+    int numRowGroups) {
+  if(numRowGroups <= 0)
+    return -1;
+
+  // Clauses starting with a prefix sort between it and it followed by 0xFF,
+  // which UTF-8 never uses, so the clause index finds them
+  sqlite3_stmt* stmt = prepareMemoStatement(p, &p->memoObserved,
+      "SELECT actual FROM \"_%w_rowgroups\" WHERE clause >= ?1 AND clause < ?2 "
+      "AND NOT (clause >= ?3 AND clause < ?4) "
+      "AND size = ?5 AND mtime = ?6 AND footer_hash = ?7 LIMIT 100");
+  if(stmt == NULL)
+    return -1;
+
+  std::string prefix = describePrefix(column, op);
+  std::string prefixEnd = prefix + "\xff";
+  // "x IS " is a prefix of "x IS NOT ..."
+  std::string exclude = op == Is ? prefix + "NOT " : "";
+  std::string excludeEnd = op == Is ? exclude + "\xff" : "";
+
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> reset(stmt, sqlite3_reset);
+  sqlite3_bind_text(stmt, 1, prefix.data(), prefix.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, prefixEnd.data(), prefixEnd.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, exclude.data(), exclude.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 4, excludeEnd.data(), excludeEnd.size(), SQLITE_STATIC);
+  bindFingerprint(stmt, 5, p->table);
+
+  double total = 0;
+  int clauses = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW) {
+    int size = sqlite3_column_bytes(stmt, 0);
+    const unsigned char* blob = (const unsigned char*)sqlite3_column_blob(stmt, 0);
+    int hits = 0;
+    for(int i = 0; i < numRowGroups && i / 8 < size; i++) {
+      if(blob[i / 8] & (1 << (i % 8)))
+        hits++;
     }
+    total += (double)hits / numRowGroups;
+    clauses++;
   }
 
-  sqlite3_finalize(pStmt);
-  return rv;
+  if(clauses == 0)
+    return -1;
+  return total / clauses;
+}
+
+/*
+** Read a constraint's value, applying the column's affinity to it as SQLite
+** would. arg is SQLite's, so we work on a copy.
+*/
+static void readConstraintValue(
+    sqlite3_value* arg,
+    ColumnAffinity affinity,
+    ValueType& type,
+    int64_t& intValue,
+    double& doubleValue,
+    std::vector<unsigned char>& blobValue) {
+  std::unique_ptr<sqlite3_value, void(*)(sqlite3_value*)> value(
+      sqlite3_value_dup(arg), sqlite3_value_free);
+  if(value.get() == NULL)
+    throw std::bad_alloc();
+
+  type = Null;
+  int sqliteType = sqlite3_value_type(value.get());
+  if((affinity == IntegerAffinity || affinity == RealAffinity) && sqliteType == SQLITE_TEXT)
+    sqliteType = sqlite3_value_numeric_type(value.get());
+  else if(affinity == TextAffinity && (sqliteType == SQLITE_INTEGER || sqliteType == SQLITE_FLOAT))
+    sqliteType = SQLITE_TEXT;
+
+  if(sqliteType == SQLITE_INTEGER) {
+    type = Integer;
+    intValue = sqlite3_value_int64(value.get());
+  } else if(sqliteType == SQLITE_FLOAT) {
+    type = Double;
+    doubleValue = sqlite3_value_double(value.get());
+  } else if(sqliteType == SQLITE_TEXT) {
+    type = Text;
+    const unsigned char* ptr = sqlite3_value_text(value.get());
+    int len = sqlite3_value_bytes(value.get());
+    for(int k = 0; k < len; k++) {
+      blobValue.push_back(ptr[k]);
+    }
+  } else if(sqliteType == SQLITE_BLOB) {
+    type = Blob;
+    const unsigned char* ptr = (const unsigned char*)sqlite3_value_blob(value.get());
+    int len = sqlite3_value_bytes(value.get());
+    for(int k = 0; k < len; k++) {
+      blobValue.push_back(ptr[k]);
+    }
+  }
+}
+
+/*
+** Read the values of an IN list that xBestIndex asked SQLite to hand over
+** all at once, coerced to the column's type. Values that no row can equal,
+** like NULL or 2.5 on an integer column, are dropped.
+*/
+static void readInList(
+    sqlite3_value* list,
+    ColumnAffinity affinity,
+    std::vector<int64_t>& intValues,
+    std::vector<double>& doubleValues,
+    std::vector<std::string>& stringValues) {
+#if SQLITE_VERSION_NUMBER >= 3038000
+  sqlite3_value* value = NULL;
+  int rc = sqlite3_vtab_in_first(list, &value);
+  while(rc == SQLITE_OK) {
+    ConstraintOperator op = Equal;
+    ValueType type = Null;
+    int64_t intValue = 0;
+    double doubleValue = 0;
+    std::vector<unsigned char> blobValue;
+    readConstraintValue(value, affinity, type, intValue, doubleValue, blobValue);
+    coerceConstraint(affinity, op, type, intValue, doubleValue);
+
+    if(type == Integer)
+      intValues.push_back(intValue);
+    else if(type == Double)
+      doubleValues.push_back(doubleValue);
+    else if(type == Text)
+      stringValues.push_back(std::string(blobValue.begin(), blobValue.end()));
+
+    rc = sqlite3_vtab_in_next(list, &value);
+  }
+
+  if(rc != SQLITE_DONE) {
+    if(rc == SQLITE_NOMEM)
+      throw std::bad_alloc();
+
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to read IN list: " << sqlite3_errstr(rc);
+    throw std::invalid_argument(ss.str());
+  }
+#else
+  std::ostringstream ss;
+  ss << __FILE__ << ":" << __LINE__ << ": IN lists need SQLite 3.38";
+  throw std::invalid_argument(ss.str());
+#endif
 }
 
+/*
+** Flag each column the statement uses, per the colUsed mask xBestIndex was
+** given. Bit 63 stands for every column after the 63rd.
+*/
+static std::vector<unsigned char> getColumnsUsed(ParquetTable* table, sqlite3_index_info* indexInfo) {
+  unsigned int numColumns = table->getNumColumns();
+
+  // colUsed arrived in SQLite 3.10; assume older ones want everything
+  if(sqlite3_libversion_number() < 3010000)
+    return std::vector<unsigned char>(numColumns, 1);
+
+  std::vector<unsigned char> rv(numColumns, 0);
+  for(unsigned int i = 0; i < numColumns; i++) {
+    int bit = i < 63 ? i : 63;
+    rv[i] = (indexInfo->colUsed >> bit) & 1;
+  }
+  return rv;
+}
 
 /*
 ** Only a full table scan is supported.  So xFilter simply rewinds to
@@ -532,6 +1217,9 @@ static int parquetFilter(
     ParquetCursor* cursor = vtab_cursor_parquet->cursor;
     sqlite3_index_info* indexInfo = (sqlite3_index_info*)idxStr;
 
+    // The last scan, if cut short, hasn't had its findings written
+    flushMemo(vtab_cursor_parquet);
+
 #ifdef DEBUG
   struct timeval tv;
   gettimeofday(&tv, NULL);
@@ -543,40 +1231,64 @@ static int parquetFilter(
     debugConstraints(indexInfo, cursor->getTable(), argc, argv);
 #endif
     std::vector<Constraint> constraints;
-    int j = 0;
+    int64_t limit = -1;
+    int64_t offset = 0;
     for(int i = 0; i < indexInfo->nConstraint; i++) {
-      if(!indexInfo->aConstraint[i].usable) {
+      int j = indexInfo->aConstraintUsage[i].argvIndex - 1;
+      if(j < 0) {
         continue;
       }
 
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+      if(indexInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_LIMIT) {
+        limit = sqlite3_value_int64(argv[j]);
+        continue;
+      }
+      if(indexInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
+        offset = sqlite3_value_int64(argv[j]);
+        continue;
+      }
+#endif
+
+      ConstraintOperator op = constraintOperatorFromSqlite(indexInfo->aConstraint[i].op);
+      ColumnAffinity affinity = isComparison(op) ?
+        getColumnAffinity(cursor->getTable(), indexInfo->aConstraint[i].iColumn) :
+        NoAffinity;
+
       ValueType type = Null;
       int64_t intValue = 0;
       double doubleValue = 0;
       std::vector<unsigned char> blobValue;
-      int sqliteType = sqlite3_value_type(argv[j]);
-
-      if(sqliteType == SQLITE_INTEGER) {
-        type = Integer;
-        intValue = sqlite3_value_int64(argv[j]);
-      } else if(sqliteType == SQLITE_FLOAT) {
-        type = Double;
-        doubleValue = sqlite3_value_double(argv[j]);
-      } else if(sqliteType == SQLITE_TEXT) {
-        type = Text;
-        int len = sqlite3_value_bytes(argv[j]);
-        const unsigned char* ptr = sqlite3_value_text(argv[j]);
-        for(int k = 0; k < len; k++) {
-          blobValue.push_back(ptr[k]);
-        }
-      } else if(sqliteType == SQLITE_BLOB) {
-        type = Blob;
-        int len = sqlite3_value_bytes(argv[j]);
-        const unsigned char* ptr = (const unsigned char*)sqlite3_value_blob(argv[j]);
-        for(int k = 0; k < len; k++) {
-          blobValue.push_back(ptr[k]);
-        }
-      } else if(sqliteType == SQLITE_NULL) {
-        type = Null;
+      std::vector<int64_t> intValues;
+      std::vector<double> doubleValues;
+      std::vector<std::string> stringValues;
+
+      if(i < 31 && (idxNum & (1 << i))) {
+        readInList(argv[j], affinity, intValues, doubleValues, stringValues);
+        if(affinity == IntegerAffinity && !intValues.empty())
+          type = Integer;
+        else if(affinity == RealAffinity && !doubleValues.empty())
+          type = Double;
+        else if(affinity == TextAffinity && !stringValues.empty())
+          type = Text;
+
+        // An empty list matches nothing, which we spell "= NULL"
+        op = type == Null ? Equal : In;
+      } else {
+        // The value of a comparison on a text column that SQLite checks
+        // again may have an affinity of its own, as another table's column
+        // does. Only text equality is the same whatever the affinity; leave
+        // anything else to SQLite.
+        if(affinity == TextAffinity && !indexInfo->aConstraintUsage[i].omit &&
+            (sqlite3_value_type(argv[j]) != SQLITE_TEXT ||
+             (op != Equal && op != Is && op != NotEqual && op != IsNot)))
+          continue;
+
+        readConstraintValue(argv[j], affinity, type, intValue, doubleValue, blobValue);
+
+        // A constraint every row satisfies needn't be passed on
+        if(!coerceConstraint(affinity, op, type, intValue, doubleValue))
+          continue;
       }
 
       std::string columnName = "rowid";
@@ -589,13 +1301,17 @@ static int parquetFilter(
         bitmap,
         indexInfo->aConstraint[i].iColumn,
         columnName,
-        constraintOperatorFromSqlite(indexInfo->aConstraint[i].op),
+        op,
         type,
         intValue,
         doubleValue,
         blobValue);
+      dummy.intValues = intValues;
+      dummy.doubleValues = doubleValues;
+      dummy.stringValues = stringValues;
+      dummy.sortValues();
 
-      std::vector<unsigned char> actual = getRowGroupsForClause(db, cursor->getTable()->getTableName(), dummy.describe());
+      std::vector<unsigned char> actual = getRowGroupsForClause(vtab_parquet, dummy.describe());
       if(actual.size() > 0) {
         // Initialize the estimate to be the actual -- eventually they'll converge
         // and we'll stop writing back to the db.
@@ -607,16 +1323,31 @@ static int parquetFilter(
         bitmap,
         indexInfo->aConstraint[i].iColumn,
         columnName,
-        constraintOperatorFromSqlite(indexInfo->aConstraint[i].op),
+        op,
         type,
         intValue,
         doubleValue,
         blobValue);
+      constraint.intValues.swap(dummy.intValues);
+      constraint.doubleValues.swap(dummy.doubleValues);
+      constraint.stringValues.swap(dummy.stringValues);
+
+      if(op == Equal || op == Is || op == In)
+        loadBloomFilters(db, cursor->getTable(), constraint.column);
 
       constraints.push_back(constraint);
-      j++;
     }
-    cursor->reset(constraints);
+    // What's known of the row groups matching every constraint at once
+    RowGroupBitmap conjunction(cursor->getNumRowGroups());
+    std::string conjunctionKey = describeConjunction(constraints);
+    if(!conjunctionKey.empty()) {
+      std::vector<unsigned char> actual = getRowGroupsForClause(vtab_parquet, conjunctionKey);
+      if(actual.size() == conjunction.actualMembership.size())
+        conjunction = RowGroupBitmap(actual, actual);
+    }
+
+    cursor->reset(constraints, conjunction, limit, offset, getColumnsUsed(cursor->getTable(), indexInfo));
+    vtab_cursor_parquet->memoPending = 1;
     return parquetNext(cur);
   } catch(std::bad_alloc& ba) {
     return SQLITE_NOMEM;
@@ -625,6 +1356,134 @@ static int parquetFilter(
   }
 }
 
+// How likely a row is to satisfy a constraint, given that it's in a row group
+// that the constraint couldn't rule out. We don't get to see the constraint's
+// value here, so these are SQLite's own rules of thumb.
+static double withinRowGroupSelectivity(ConstraintOperator op, const ColumnEstimate& estimate) {
+  switch(op) {
+    case Equal:
+    case Is:
+    case In:
+      return 0.1;
+    case GreaterThan:
+    case GreaterThanOrEqual:
+    case LessThan:
+    case LessThanOrEqual:
+      return 1.0 / 3;
+    case Like:
+    case Glob:
+      return 0.25;
+    case NotEqual:
+    case IsNot:
+      return 0.9;
+    case IsNull:
+      return estimate.nullFraction;
+    case IsNotNull:
+      return 1 - estimate.nullFraction;
+  }
+  return 1;
+}
+
+/*
+* Fill in estimatedRows and estimatedCost for the usable constraints.
+*
+* A row group costs about the same to scan whether or not any of its rows
+* match, so the cost is the number of rows in the row groups we expect to
+* read, plus a little for each row we return. The fraction of row groups
+* read comes from what xFilter observed for earlier constraints on the same
+* column and operator, when there are any; otherwise, for equality, from how
+* much the row groups' min/max ranges overlap.
+*/
+static void estimateIndex(sqlite3_vtab_parquet* vtab, sqlite3_index_info* pIdxInfo) {
+  ParquetTable* table = vtab->table;
+  double numRows = table->getNumRows();
+  int numRowGroups = table->getNumRowGroups();
+  if(numRows < 1)
+    numRows = 1;
+
+  double selectivity = 1;
+  double rowGroupFraction = 1;
+  bool unique = false;
+
+  for(int i = 0; i < pIdxInfo->nConstraint; i++) {
+    if(!pIdxInfo->aConstraint[i].usable)
+      continue;
+
+    ConstraintOperator op;
+    try {
+      op = constraintOperatorFromSqlite(pIdxInfo->aConstraint[i].op);
+    } catch(std::invalid_argument& e) {
+      continue;
+    }
+
+    int col = pIdxInfo->aConstraint[i].iColumn;
+    double groups = 1;
+    double within = 1;
+    if(col < 0) {
+      // Row groups are contiguous runs of rowids, so these prune exactly
+      if(op == Equal || op == Is) {
+        unique = true;
+        continue;
+      }
+      if(op == GreaterThan || op == GreaterThanOrEqual || op == LessThan || op == LessThanOrEqual)
+        groups = 1.0 / 3;
+    } else {
+      const ColumnEstimate& estimate = table->getColumnEstimate(col);
+      within = withinRowGroupSelectivity(op, estimate);
+
+      double observed = getObservedRowGroupFraction(
+          vtab,
+          table->columnName(col),
+          op,
+          numRowGroups);
+      if(observed >= 0)
+        groups = observed;
+      else if(op == Equal || op == Is)
+        groups = estimate.pointHitFraction;
+    }
+
+    selectivity *= groups * within;
+    if(groups < rowGroupFraction)
+      rowGroupFraction = groups;
+  }
+
+  if(unique) {
+    // One row, from one row group
+    pIdxInfo->estimatedRows = 1;
+    pIdxInfo->estimatedCost = numRows / (numRowGroups > 0 ? numRowGroups : 1);
+    pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+    return;
+  }
+
+  double rows = numRows * selectivity;
+  if(rows < 1)
+    rows = 1;
+  pIdxInfo->estimatedRows = rows;
+  pIdxInfo->estimatedCost = numRows * rowGroupFraction + rows;
+}
+
+/*
+** Whether constraint i is an IN whose values SQLite can pass to xFilter all
+** at once, and if so, ask it to. Otherwise each value gets its own xFilter
+** call. The cursor only evaluates the list exactly, so this is only worth
+** asking for constraints that are omitted.
+*/
+static bool takesWholeInList(sqlite3_index_info* pIdxInfo, int i) {
+#if SQLITE_VERSION_NUMBER >= 3038000
+  // The extension may be loaded into an older SQLite than it was built with
+  if(sqlite3_libversion_number() < 3038000)
+    return false;
+
+  if(pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ || !sqlite3_vtab_in(pIdxInfo, i, -1))
+    return false;
+
+  sqlite3_vtab_in(pIdxInfo, i, 1);
+  return true;
+#else
+  return false;
+#endif
+}
+
 /*
 * We'll always indicate to SQLite that we prefer it to use an index so that it will
 * pass additional context to xFilter, which we may or may not use.
@@ -636,6 +1495,7 @@ static int parquetBestIndex(
   sqlite3_index_info *pIdxInfo
 ){
   try {
+    ParquetTable* table = ((sqlite3_vtab_parquet*)tab)->table;
 
 #ifdef DEBUG
     struct timeval tv;
@@ -644,8 +1504,6 @@ static int parquetBestIndex(
       (unsigned long long)(tv.tv_sec) * 1000 +
       (unsigned long long)(tv.tv_usec) / 1000;
 
-
-    ParquetTable* table = ((sqlite3_vtab_parquet*)tab)->table;
     printf("%llu xBestIndex: nConstraint=%d, nOrderBy=%d\n", millisecondsSinceEpoch, pIdxInfo->nConstraint, pIdxInfo->nOrderBy);
     debugConstraints(pIdxInfo, table, 0, NULL);
 #endif
@@ -655,19 +1513,52 @@ static int parquetBestIndex(
     if(pIdxInfo->nOrderBy == 1 && pIdxInfo->aOrderBy[0].iColumn == -1 && pIdxInfo->aOrderBy[0].desc == 0)
       pIdxInfo->orderByConsumed = 1;
 
-    if(pIdxInfo->nConstraint == 0) {
-      pIdxInfo->estimatedCost = 1000000000000;
-      pIdxInfo->idxNum = 0;
-    } else {
-      pIdxInfo->estimatedCost = 1;
-      pIdxInfo->idxNum = 1;
+    // Likewise for a column the file is sorted by
+    if(pIdxInfo->nOrderBy == 1 && pIdxInfo->aOrderBy[0].iColumn >= 0) {
+      int rowOrder = table->getColumnOrder(pIdxInfo->aOrderBy[0].iColumn).rowOrder;
+      if(rowOrder != 0 && rowOrder == (pIdxInfo->aOrderBy[0].desc ? -1 : 1))
+        pIdxInfo->orderByConsumed = 1;
+    }
+
+    estimateIndex((sqlite3_vtab_parquet*)tab, pIdxInfo);
+
+    // Bit i of idxNum is set if constraint i's value is an IN list that
+    // SQLite will hand over all at once
+    pIdxInfo->idxNum = 0;
+    if(pIdxInfo->nConstraint > 0) {
       int j = 0;
+      // Whether we return exactly the rows SQLite wants, in the order it
+      // wants them, so that it's safe to apply LIMIT and OFFSET ourselves
+      bool exact = pIdxInfo->nOrderBy == 0 || pIdxInfo->orderByConsumed;
 
       for(int i = 0; i < pIdxInfo->nConstraint; i++) {
-        if(pIdxInfo->aConstraint[i].usable) {
+        if(isLimitOrOffset(pIdxInfo->aConstraint[i].op))
+          continue;
+
+        if(!pIdxInfo->aConstraint[i].usable || !isSupportedOperator(pIdxInfo->aConstraint[i].op)) {
+          exact = false;
+          continue;
+        }
+
+        j++;
+        pIdxInfo->aConstraintUsage[i].argvIndex = j;
+        pIdxInfo->aConstraintUsage[i].omit = isExactConstraint(table, pIdxInfo, i);
+        exact = exact && pIdxInfo->aConstraintUsage[i].omit;
+
+        if(i < 31 && pIdxInfo->aConstraintUsage[i].omit && takesWholeInList(pIdxInfo, i))
+          pIdxInfo->idxNum |= 1 << i;
+      }
+
+      // SQLite applies the limit to what we return, too, but skips the
+      // offset if we say we've applied it.
+      for(int i = 0; exact && i < pIdxInfo->nConstraint; i++) {
+        int op = pIdxInfo->aConstraint[i].op;
+        if(pIdxInfo->aConstraint[i].usable && isLimitOrOffset(op)) {
           j++;
           pIdxInfo->aConstraintUsage[i].argvIndex = j;
-//          pIdxInfo->aConstraintUsage[i].omit = 1;
+#ifdef SQLITE_INDEX_CONSTRAINT_OFFSET
+          pIdxInfo->aConstraintUsage[i].omit = op == SQLITE_INDEX_CONSTRAINT_OFFSET;
+#endif
         }
       }
     }
@@ -718,6 +1609,609 @@ static int parquetBestIndex(
 }
 
 
+/*
+** parquet_config(name) returns the current value of a process-wide setting;
+** parquet_config(name, value) changes it first. Settings:
+**
+**   max_open_files   soft cap on the number of Parquet files kept open by
+**                    the reader pool, shared by every connection
+**   metadata_cache_bytes
+**                    bytes of parsed footers kept for connecting tables,
+**                    shared by every connection
+**   column_cache_bytes
+**                    bytes of decoded column chunks kept for scans to share;
+**                    0 turns the cache off
+**
+** and, read-only, column_cache_hits and column_cache_misses: how often scans
+** have found a column chunk in that cache, and not.
+*/
+static void parquetConfigFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  try {
+    if(argc < 1 || argc > 2) {
+      sqlite3_result_error(ctx, "parquet_config takes a setting name and optionally a value", -1);
+      return;
+    }
+
+    const char* name = (const char*)sqlite3_value_text(argv[0]);
+    if(name == NULL) {
+      sqlite3_result_error(ctx, "parquet_config: setting name must not be NULL", -1);
+      return;
+    }
+
+    if(strcmp(name, "max_open_files") == 0) {
+      ParquetReaderPool& pool = ParquetReaderPool::instance();
+      if(argc == 2) {
+        sqlite3_int64 value = sqlite3_value_int64(argv[1]);
+        if(sqlite3_value_numeric_type(argv[1]) != SQLITE_INTEGER || value < 0) {
+          sqlite3_result_error(ctx, "parquet_config: max_open_files must be a non-negative integer", -1);
+          return;
+        }
+        pool.setMaxOpenFiles(value);
+      }
+      sqlite3_result_int64(ctx, pool.getMaxOpenFiles());
+      return;
+    }
+
+    if(strcmp(name, "metadata_cache_bytes") == 0) {
+      ParquetMetadataCache& cache = ParquetMetadataCache::instance();
+      if(argc == 2) {
+        sqlite3_int64 value = sqlite3_value_int64(argv[1]);
+        if(sqlite3_value_numeric_type(argv[1]) != SQLITE_INTEGER || value < 0) {
+          sqlite3_result_error(ctx, "parquet_config: metadata_cache_bytes must be a non-negative integer", -1);
+          return;
+        }
+        cache.setMaxBytes(value);
+      }
+      sqlite3_result_int64(ctx, cache.getMaxBytes());
+      return;
+    }
+
+    if(strcmp(name, "column_cache_bytes") == 0) {
+      ColumnChunkCache& cache = ColumnChunkCache::instance();
+      if(argc == 2) {
+        sqlite3_int64 value = sqlite3_value_int64(argv[1]);
+        if(sqlite3_value_numeric_type(argv[1]) != SQLITE_INTEGER || value < 0) {
+          sqlite3_result_error(ctx, "parquet_config: column_cache_bytes must be a non-negative integer", -1);
+          return;
+        }
+        cache.setMaxBytes(value);
+      }
+      sqlite3_result_int64(ctx, cache.getMaxBytes());
+      return;
+    }
+
+    if(strcmp(name, "column_cache_hits") == 0 || strcmp(name, "column_cache_misses") == 0) {
+      if(argc == 2) {
+        char* msg = sqlite3_mprintf("parquet_config: %s is read-only", name);
+        sqlite3_result_error(ctx, msg, -1);
+        sqlite3_free(msg);
+        return;
+      }
+      ColumnChunkCache& cache = ColumnChunkCache::instance();
+      sqlite3_result_int64(ctx, strcmp(name, "column_cache_hits") == 0 ? cache.getHits() : cache.getMisses());
+      return;
+    }
+
+    char* msg = sqlite3_mprintf("parquet_config: unknown setting '%s'", name);
+    sqlite3_result_error(ctx, msg, -1);
+    sqlite3_free(msg);
+  } catch(std::bad_alloc& ba) {
+    sqlite3_result_error_nomem(ctx);
+  } catch(std::exception& e) {
+    sqlite3_result_error(ctx, e.what(), -1);
+  }
+}
+
+// One filter per row group of the column, sized for its distinct values
+static std::vector<std::shared_ptr<BloomFilter>> buildBloomFilters(ParquetTable* table, int col) {
+  std::vector<std::shared_ptr<BloomFilter>> rv;
+
+  ParquetCursor cursor(table);
+  std::vector<unsigned char> columnsUsed(table->getNumColumns(), 0);
+  columnsUsed[col] = 1;
+  cursor.reset(std::vector<Constraint>(), RowGroupBitmap(0), -1, 0, columnsUsed);
+  parquet::Type::type physical = cursor.getPhysicalType(col);
+  int numRowGroups = cursor.getNumRowGroups();
+
+  std::vector<uint64_t> hashes;
+  cursor.next();
+  while(true) {
+    // Finish the row groups that the cursor has moved past
+    bool done = cursor.eof();
+    while((int)rv.size() < numRowGroups &&
+        (done || cursor.getRowId() > table->getRowGroupStart(rv.size() + 1))) {
+      std::sort(hashes.begin(), hashes.end());
+      hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+      std::shared_ptr<BloomFilter> filter(new BloomFilter(BloomFilter::sized(hashes.size())));
+      for(unsigned int i = 0; i < hashes.size(); i++)
+        filter->insert(hashes[i]);
+      rv.push_back(filter);
+      hashes.clear();
+    }
+    if(done)
+      break;
+
+    cursor.ensureColumn(col);
+    if(!cursor.isNull(col)) {
+      switch(physical) {
+        case parquet::Type::INT32:
+        {
+          int32_t value = cursor.getInt32(col);
+          hashes.push_back(xxHash64(&value, sizeof(value)));
+          break;
+        }
+        case parquet::Type::INT64:
+        {
+          int64_t value = cursor.getInt64(col);
+          hashes.push_back(xxHash64(&value, sizeof(value)));
+          break;
+        }
+        case parquet::Type::FLOAT:
+        {
+          float value = cursor.getDouble(col);
+          hashes.push_back(xxHash64(&value, sizeof(value)));
+          break;
+        }
+        case parquet::Type::DOUBLE:
+        {
+          double value = cursor.getDouble(col);
+          hashes.push_back(xxHash64(&value, sizeof(value)));
+          break;
+        }
+        default:
+        {
+          parquet::ByteArray* value = cursor.getByteArray(col);
+          hashes.push_back(xxHash64(value->ptr, value->len));
+        }
+      }
+    }
+    cursor.next();
+  }
+
+  cursor.close();
+  return rv;
+}
+
+// Write the column's filters to the table's _<table>_blooms shadow table,
+// in place of its old ones and any for other versions of the files
+static void writeBloomFilters(
+    sqlite3* db,
+    ParquetTable* table,
+    int col,
+    const std::vector<std::shared_ptr<BloomFilter>>& filters) {
+  const std::string& name = table->getTableName();
+  dropUnstampedTable(db, "_" + name + "_blooms");
+
+  // Tables created before there were bloom filters don't have it yet
+  std::unique_ptr<char, void(*)(void*)> sql(sqlite3_mprintf(
+      "CREATE TABLE IF NOT EXISTS \"_%w_blooms\"(" BLOOM_COLUMNS ")",
+      name.c_str()), sqlite3_free);
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+  if(sqlite3_exec(db, sql.get(), 0, 0, 0) != SQLITE_OK)
+    throw std::invalid_argument(sqlite3_errmsg(db));
+
+  sql.reset(sqlite3_mprintf(
+      "DELETE FROM \"_%w_blooms\" "
+      "WHERE col = ?1 OR size IS NOT ?2 OR mtime IS NOT ?3 OR footer_hash IS NOT ?4",
+      name.c_str()));
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+
+  sqlite3_stmt* pStmt = NULL;
+  if(sqlite3_prepare_v2(db, sql.get(), -1, &pStmt, NULL) != SQLITE_OK)
+    throw std::invalid_argument(sqlite3_errmsg(db));
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> stmt(pStmt, sqlite3_finalize);
+
+  sqlite3_bind_text(pStmt, 1, table->columnName(col).c_str(), -1, SQLITE_TRANSIENT);
+  bindFingerprint(pStmt, 2, table);
+  if(sqlite3_step(pStmt) != SQLITE_DONE)
+    throw std::invalid_argument(sqlite3_errmsg(db));
+
+  sql.reset(sqlite3_mprintf(
+      "INSERT INTO \"_%w_blooms\"(col, rowgroup, rows, filter, size, mtime, footer_hash) "
+      "VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7)",
+      name.c_str()));
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+
+  pStmt = NULL;
+  if(sqlite3_prepare_v2(db, sql.get(), -1, &pStmt, NULL) != SQLITE_OK)
+    throw std::invalid_argument(sqlite3_errmsg(db));
+  stmt.reset(pStmt);
+
+  sqlite3_bind_text(pStmt, 1, table->columnName(col).c_str(), -1, SQLITE_TRANSIENT);
+  bindFingerprint(pStmt, 5, table);
+  for(unsigned int i = 0; i < filters.size(); i++) {
+    const std::vector<uint8_t>& bitset = filters[i]->getBitset();
+    sqlite3_bind_int64(pStmt, 2, i);
+    sqlite3_bind_int64(pStmt, 3, table->getRowGroupStart(i + 1) - table->getRowGroupStart(i));
+    sqlite3_bind_blob(pStmt, 4, bitset.data(), bitset.size(), SQLITE_STATIC);
+    if(sqlite3_step(pStmt) != SQLITE_DONE)
+      throw std::invalid_argument(sqlite3_errmsg(db));
+    sqlite3_reset(pStmt);
+  }
+}
+
+// Replace the column's filters in one go, so a failure part way through
+// leaves the old ones in place
+static void storeBloomFilters(
+    sqlite3* db,
+    ParquetTable* table,
+    int col,
+    const std::vector<std::shared_ptr<BloomFilter>>& filters) {
+  if(sqlite3_exec(db, "SAVEPOINT parquet_bloom", 0, 0, 0) != SQLITE_OK)
+    throw std::invalid_argument(sqlite3_errmsg(db));
+
+  try {
+    writeBloomFilters(db, table, col, filters);
+    if(sqlite3_exec(db, "RELEASE parquet_bloom", 0, 0, 0) != SQLITE_OK)
+      throw std::invalid_argument(sqlite3_errmsg(db));
+  } catch(...) {
+    // Don't leave the savepoint, and perhaps a transaction, open
+    sqlite3_exec(db, "ROLLBACK TO parquet_bloom", 0, 0, 0);
+    sqlite3_exec(db, "RELEASE parquet_bloom", 0, 0, 0);
+    throw;
+  }
+}
+
+// Find a parquet table by name, connecting it if nothing has used it yet.
+// NULL if there's no such table, or it isn't a parquet table.
+static ParquetTable* connectTable(sqlite3* db, const char* tableName) {
+  // Preparing a query on the table connects it
+  std::unique_ptr<char, void(*)(void*)> sql(
+      sqlite3_mprintf("SELECT rowid FROM \"%w\"", tableName), sqlite3_free);
+  if(sql.get() == NULL)
+    throw std::bad_alloc();
+  sqlite3_stmt* pStmt = NULL;
+  sqlite3_prepare_v2(db, sql.get(), -1, &pStmt, NULL);
+  std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> stmt(pStmt, sqlite3_finalize);
+
+  return findTable(db, tableName);
+}
+
+// parquet_build_bloom('table', 'column') builds a bloom filter for each of
+// the column's row groups, for equality constraints to rule them out with.
+// They're kept in a shadow table; connections that load them later prefer
+// the file's own, if it has any. Returns the number of filters built.
+static void parquetBuildBloomFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  try {
+    const char* tableName = (const char*)sqlite3_value_text(argv[0]);
+    const char* columnName = (const char*)sqlite3_value_text(argv[1]);
+    if(tableName == NULL || columnName == NULL) {
+      sqlite3_result_error(ctx, "parquet_build_bloom: table and column names must not be NULL", -1);
+      return;
+    }
+
+    sqlite3* db = sqlite3_context_db_handle(ctx);
+    ParquetTable* table = connectTable(db, tableName);
+    if(table == NULL) {
+      char* msg = sqlite3_mprintf("parquet_build_bloom: no parquet table named '%s'", tableName);
+      sqlite3_result_error(ctx, msg, -1);
+      sqlite3_free(msg);
+      return;
+    }
+
+    int col = -1;
+    for(unsigned int i = 0; i < table->getNumColumns(); i++) {
+      if(sqlite3_stricmp(table->columnName(i).c_str(), columnName) == 0)
+        col = i;
+    }
+    if(col == -1) {
+      char* msg = sqlite3_mprintf("parquet_build_bloom: %s has no column '%s'", tableName, columnName);
+      sqlite3_result_error(ctx, msg, -1);
+      sqlite3_free(msg);
+      return;
+    }
+
+    if(table->isPartitionColumn(col) ||
+        !BloomFilter::supports(table->getSchema()->Column(col)->physical_type())) {
+      char* msg = sqlite3_mprintf("parquet_build_bloom: can't build bloom filters for %s's type", columnName);
+      sqlite3_result_error(ctx, msg, -1);
+      sqlite3_free(msg);
+      return;
+    }
+
+    std::vector<std::shared_ptr<BloomFilter>> filters = buildBloomFilters(table, col);
+    storeBloomFilters(db, table, col, filters);
+
+    table->setBloomFilters(col, filters);
+    sqlite3_result_int64(ctx, filters.size());
+  } catch(std::bad_alloc& ba) {
+    sqlite3_result_error_nomem(ctx);
+  } catch(std::exception& e) {
+    sqlite3_result_error(ctx, e.what(), -1);
+  }
+}
+
+/*
+** parquet_metadata(source) is an eponymous table of what a file's footer
+** says, so that questions like how many rows a file has, or its range of
+** timestamps, are answered without reading any data. source is the name of
+** a parquet table, or a path as parquet() takes it.
+**
+** There's a row for each column chunk, and rollups of them: row_group is
+** NULL in a row summing a column over the file's row groups, column_name is
+** NULL in a row summing a row group's columns, and both are NULL in the
+** file's total. min and max are NULL where the statistics don't say.
+*/
+enum MetadataColumn {
+  MetadataFile,
+  MetadataRowGroup,
+  MetadataColumnName,
+  MetadataType,
+  MetadataNumRows,
+  MetadataNumValues,
+  MetadataNullCount,
+  MetadataMin,
+  MetadataMax,
+  MetadataCompressedSize,
+  MetadataUncompressedSize,
+  MetadataEncodings,
+  MetadataCompression,
+  MetadataSource
+};
+
+typedef struct sqlite3_vtab_parquet_metadata {
+  sqlite3_vtab base;              /* Base class.  Must be first */
+  sqlite3* db;
+} sqlite3_vtab_parquet_metadata;
+
+// The rows of one scan, read in full by xFilter
+struct MetadataScan {
+  std::vector<MetadataRow> rows;
+  std::vector<std::string> columnNames;
+  std::vector<std::string> types;
+  unsigned int row;
+};
+
+typedef struct sqlite3_vtab_cursor_parquet_metadata {
+  sqlite3_vtab_cursor base;       /* Base class.  Must be first */
+  MetadataScan* scan;
+} sqlite3_vtab_cursor_parquet_metadata;
+
+static int parquetMetadataConnect(
+  sqlite3 *db,
+  void *pAux,
+  int argc,
+  const char *const*argv,
+  sqlite3_vtab **ppVtab,
+  char **pzErr
+){
+  int rc = sqlite3_declare_vtab(db,
+      "CREATE TABLE x(file TEXT, row_group INTEGER, column_name TEXT, type TEXT, "
+      "num_rows INTEGER, num_values INTEGER, null_count INTEGER, min, max, "
+      "compressed_size INTEGER, uncompressed_size INTEGER, encodings TEXT, "
+      "compression TEXT, source HIDDEN)");
+  if(rc != SQLITE_OK)
+    return rc;
+
+#if SQLITE_VERSION_NUMBER >= 3031000
+  // It reads whatever file it's given, so keep it out of views and
+  // triggers that a database's author could have planted
+  sqlite3_vtab_config(db, SQLITE_VTAB_DIRECTONLY);
+#endif
+
+  sqlite3_vtab_parquet_metadata* vtab =
+    (sqlite3_vtab_parquet_metadata*)sqlite3_malloc(sizeof(sqlite3_vtab_parquet_metadata));
+  if(vtab == NULL)
+    return SQLITE_NOMEM;
+  memset(vtab, 0, sizeof(*vtab));
+  vtab->db = db;
+  *ppVtab = (sqlite3_vtab*)vtab;
+  return SQLITE_OK;
+}
+
+static int parquetMetadataDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+// The source must be given; the other columns are left to SQLite.
+static int parquetMetadataBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo){
+  bool unusable = false;
+  for(int i = 0; i < pIdxInfo->nConstraint; i++) {
+    const sqlite3_index_info::sqlite3_index_constraint& constraint = pIdxInfo->aConstraint[i];
+    if(constraint.iColumn != MetadataSource || constraint.op != SQLITE_INDEX_CONSTRAINT_EQ)
+      continue;
+    if(!constraint.usable) {
+      unusable = true;
+      continue;
+    }
+
+    pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+    pIdxInfo->aConstraintUsage[i].omit = 1;
+    pIdxInfo->idxNum = 1;
+    pIdxInfo->estimatedCost = 1000;
+    pIdxInfo->estimatedRows = 1000;
+    return SQLITE_OK;
+  }
+
+  // Try another join order, with the source's value known
+  if(unusable)
+    return SQLITE_CONSTRAINT;
+
+  pIdxInfo->idxNum = 0;
+  pIdxInfo->estimatedCost = 1e99;
+  return SQLITE_OK;
+}
+
+static int parquetMetadataOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor){
+  try {
+    std::unique_ptr<sqlite3_vtab_cursor_parquet_metadata, void(*)(void*)> cursor(
+        (sqlite3_vtab_cursor_parquet_metadata*)sqlite3_malloc(sizeof(sqlite3_vtab_cursor_parquet_metadata)),
+        sqlite3_free);
+    if(cursor.get() == NULL)
+      return SQLITE_NOMEM;
+    memset(cursor.get(), 0, sizeof(*cursor.get()));
+
+    cursor->scan = new MetadataScan();
+    cursor->scan->row = 0;
+    *ppCursor = (sqlite3_vtab_cursor*)cursor.release();
+    return SQLITE_OK;
+  } catch(std::bad_alloc& ba) {
+    return SQLITE_NOMEM;
+  }
+}
+
+static int parquetMetadataClose(sqlite3_vtab_cursor *cur){
+  sqlite3_vtab_cursor_parquet_metadata* cursor = (sqlite3_vtab_cursor_parquet_metadata*)cur;
+  delete cursor->scan;
+  sqlite3_free(cur);
+  return SQLITE_OK;
+}
+
+static void describeInto(MetadataScan* scan, ParquetTable& table) {
+  scan->rows = describeTable(table);
+  scan->columnNames.clear();
+  scan->types.clear();
+  for(unsigned int i = 0; i < table.getNumFileColumns(); i++) {
+    scan->columnNames.push_back(table.columnName(i));
+    scan->types.push_back(parquet::TypeToString(table.getSchema()->Column(i)->physical_type()));
+  }
+}
+
+static int parquetMetadataFilter(
+  sqlite3_vtab_cursor *cur,
+  int idxNum,
+  const char *idxStr,
+  int argc,
+  sqlite3_value **argv
+){
+  sqlite3_vtab_cursor_parquet_metadata* cursor = (sqlite3_vtab_cursor_parquet_metadata*)cur;
+  sqlite3_vtab_parquet_metadata* vtab = (sqlite3_vtab_parquet_metadata*)cur->pVtab;
+  MetadataScan* scan = cursor->scan;
+  scan->rows.clear();
+  scan->row = 0;
+
+  const char* source = argc > 0 ? (const char*)sqlite3_value_text(argv[0]) : NULL;
+  if(source == NULL) {
+    sqlite3_free(vtab->base.zErrMsg);
+    vtab->base.zErrMsg = sqlite3_mprintf("parquet_metadata: must be given a parquet table or path");
+    return SQLITE_ERROR;
+  }
+
+  try {
+    ParquetTable* table = connectTable(vtab->db, source);
+    if(table != NULL) {
+      describeInto(scan, *table);
+    } else {
+      ParquetTable files(source, "", ParquetTableOptions());
+      describeInto(scan, files);
+    }
+    return SQLITE_OK;
+  } catch(std::bad_alloc& ba) {
+    return SQLITE_NOMEM;
+  } catch(std::exception& e) {
+    sqlite3_free(vtab->base.zErrMsg);
+    vtab->base.zErrMsg = sqlite3_mprintf("parquet_metadata: %s", e.what());
+    return SQLITE_ERROR;
+  }
+}
+
+static int parquetMetadataNext(sqlite3_vtab_cursor *cur){
+  ((sqlite3_vtab_cursor_parquet_metadata*)cur)->scan->row++;
+  return SQLITE_OK;
+}
+
+static int parquetMetadataEof(sqlite3_vtab_cursor *cur){
+  MetadataScan* scan = ((sqlite3_vtab_cursor_parquet_metadata*)cur)->scan;
+  return scan->row >= scan->rows.size();
+}
+
+static void resultStatisticsValue(sqlite3_context* ctx, const StatisticsValue& value) {
+  switch(value.type) {
+    case Integer:
+      sqlite3_result_int64(ctx, value.intValue);
+      break;
+    case Double:
+      sqlite3_result_double(ctx, value.doubleValue);
+      break;
+    case Text:
+      sqlite3_result_text(ctx, value.bytes.data(), value.bytes.size(), SQLITE_TRANSIENT);
+      break;
+    case Blob:
+      sqlite3_result_blob(ctx, value.bytes.data(), value.bytes.size(), SQLITE_TRANSIENT);
+      break;
+    default:
+      sqlite3_result_null(ctx);
+      break;
+  }
+}
+
+// -1 stands for NULL
+static void resultCount(sqlite3_context* ctx, int64_t value) {
+  if(value == -1)
+    sqlite3_result_null(ctx);
+  else
+    sqlite3_result_int64(ctx, value);
+}
+
+static int parquetMetadataColumn(
+  sqlite3_vtab_cursor *cur,
+  sqlite3_context *ctx,
+  int col
+){
+  MetadataScan* scan = ((sqlite3_vtab_cursor_parquet_metadata*)cur)->scan;
+  const MetadataRow& row = scan->rows[scan->row];
+  switch(col) {
+    case MetadataFile:
+      sqlite3_result_text(ctx, row.file.data(), row.file.size(), SQLITE_TRANSIENT);
+      break;
+    case MetadataRowGroup:
+      resultCount(ctx, row.rowGroup);
+      break;
+    case MetadataColumnName:
+      if(row.column == -1)
+        sqlite3_result_null(ctx);
+      else
+        sqlite3_result_text(ctx, scan->columnNames[row.column].data(), scan->columnNames[row.column].size(), SQLITE_TRANSIENT);
+      break;
+    case MetadataType:
+      if(row.column == -1)
+        sqlite3_result_null(ctx);
+      else
+        sqlite3_result_text(ctx, scan->types[row.column].data(), scan->types[row.column].size(), SQLITE_TRANSIENT);
+      break;
+    case MetadataNumRows:
+      sqlite3_result_int64(ctx, row.numRows);
+      break;
+    case MetadataNumValues:
+      resultCount(ctx, row.numValues);
+      break;
+    case MetadataNullCount:
+      resultCount(ctx, row.nullCount);
+      break;
+    case MetadataMin:
+      resultStatisticsValue(ctx, row.min);
+      break;
+    case MetadataMax:
+      resultStatisticsValue(ctx, row.max);
+      break;
+    case MetadataCompressedSize:
+      sqlite3_result_int64(ctx, row.compressedSize);
+      break;
+    case MetadataUncompressedSize:
+      sqlite3_result_int64(ctx, row.uncompressedSize);
+      break;
+    case MetadataEncodings:
+      sqlite3_result_text(ctx, row.encodings.data(), row.encodings.size(), SQLITE_TRANSIENT);
+      break;
+    case MetadataCompression:
+      sqlite3_result_text(ctx, row.compression.data(), row.compression.size(), SQLITE_TRANSIENT);
+      break;
+    default:
+      sqlite3_result_null(ctx);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+static int parquetMetadataRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid){
+  *pRowid = ((sqlite3_vtab_cursor_parquet_metadata*)cur)->scan->row + 1;
+  return SQLITE_OK;
+}
+
 static sqlite3_module ParquetModule = {
   0,                       /* iVersion */
   parquetCreate,            /* xCreate */
@@ -741,6 +2235,38 @@ static sqlite3_module ParquetModule = {
   0,                       /* xRename */
 };
 
+// Eponymous only: it has no xCreate
+static sqlite3_module ParquetMetadataModule = {
+  0,                       /* iVersion */
+  0,                       /* xCreate */
+  parquetMetadataConnect,   /* xConnect */
+  parquetMetadataBestIndex, /* xBestIndex */
+  parquetMetadataDisconnect, /* xDisconnect */
+  0,                       /* xDestroy */
+  parquetMetadataOpen,      /* xOpen - open a cursor */
+  parquetMetadataClose,     /* xClose - close a cursor */
+  parquetMetadataFilter,    /* xFilter - configure scan constraints */
+  parquetMetadataNext,      /* xNext - advance a cursor */
+  parquetMetadataEof,       /* xEof - check for end of scan */
+  parquetMetadataColumn,    /* xColumn - read data */
+  parquetMetadataRowid,     /* xRowid - read data */
+  0,                       /* xUpdate */
+  0,                       /* xBegin */
+  0,                       /* xSync */
+  0,                       /* xCommit */
+  0,                       /* xRollback */
+  0,                       /* xFindMethod */
+  0,                       /* xRename */
+};
+
+// The functions read files and change process-wide settings, so they may
+// only be called from top-level SQL, not from a database's views or triggers
+#if SQLITE_VERSION_NUMBER >= 3030000
+#define PARQUET_FUNCTION_FLAGS (SQLITE_UTF8 | SQLITE_DIRECTONLY)
+#else
+#define PARQUET_FUNCTION_FLAGS SQLITE_UTF8
+#endif
+
 /* 
 * This routine is called when the extension is loaded.  The new
 * Parquet virtual table module is registered with the calling database
@@ -755,6 +2281,18 @@ extern "C" {
     int rc;
     SQLITE_EXTENSION_INIT2(pApi);
     rc = sqlite3_create_module(db, "parquet", &ParquetModule, 0);
+    if(rc != SQLITE_OK)
+      return rc;
+
+    rc = sqlite3_create_module(db, "parquet_metadata", &ParquetMetadataModule, 0);
+    if(rc != SQLITE_OK)
+      return rc;
+
+    rc = sqlite3_create_function(db, "parquet_config", -1, PARQUET_FUNCTION_FLAGS, 0, parquetConfigFunc, 0, 0);
+    if(rc != SQLITE_OK)
+      return rc;
+
+    rc = sqlite3_create_function(db, "parquet_build_bloom", 2, PARQUET_FUNCTION_FLAGS, 0, parquetBuildBloomFunc, 0, 0);
     return rc;
   }
 }
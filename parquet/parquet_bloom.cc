@@ -0,0 +1,201 @@
+#include "parquet_bloom.h"
+
+#include <math.h>
+#include <string.h>
+#include <sstream>
+#include <stdexcept>
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static const size_t BYTES_PER_BLOCK = 32;
+static const size_t MAX_BYTES = 128 * 1024 * 1024;
+static const double FALSE_POSITIVE_RATE = 0.01;
+
+// From the format's specification of split-block bloom filters
+static const uint32_t SALT[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+  uint64_t rv;
+  memcpy(&rv, p, sizeof(rv));
+  return rv;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+  uint32_t rv;
+  memcpy(&rv, p, sizeof(rv));
+  return rv;
+}
+
+static inline uint64_t xxRound(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t xxMergeRound(uint64_t acc, uint64_t val) {
+  acc ^= xxRound(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t xxHash64(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  const uint8_t* end = p + len;
+  uint64_t h;
+
+  if(len >= 32) {
+    uint64_t v1 = PRIME64_1 + PRIME64_2;
+    uint64_t v2 = PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -PRIME64_1;
+    const uint8_t* limit = end - 32;
+    do {
+      v1 = xxRound(v1, read64(p));
+      v2 = xxRound(v2, read64(p + 8));
+      v3 = xxRound(v3, read64(p + 16));
+      v4 = xxRound(v4, read64(p + 24));
+      p += 32;
+    } while(p <= limit);
+
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxMergeRound(h, v1);
+    h = xxMergeRound(h, v2);
+    h = xxMergeRound(h, v3);
+    h = xxMergeRound(h, v4);
+  } else {
+    h = PRIME64_5;
+  }
+
+  h += len;
+
+  for(; p + 8 <= end; p += 8) {
+    h ^= xxRound(0, read64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+  }
+
+  if(p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+
+  for(; p < end; p++) {
+    h ^= *p * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+BloomFilter::BloomFilter(std::vector<uint8_t> bitset): bitset(std::move(bitset)) {
+  if(this->bitset.empty() || this->bitset.size() % BYTES_PER_BLOCK != 0) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": bloom filter of " << this->bitset.size() <<
+      " bytes isn't a whole number of blocks";
+    throw std::invalid_argument(ss.str());
+  }
+}
+
+BloomFilter BloomFilter::sized(size_t numDistinct) {
+  // Each value sets 8 bits in a block, so a block can be seen as 8 filters
+  // of one hash function each
+  double bits = -8.0 * numDistinct / log(1 - pow(FALSE_POSITIVE_RATE, 1.0 / 8));
+  size_t bytes = BYTES_PER_BLOCK;
+  while(bytes < MAX_BYTES && bytes * 8 < bits)
+    bytes *= 2;
+  return BloomFilter(std::vector<uint8_t>(bytes, 0));
+}
+
+bool BloomFilter::supports(parquet::Type::type physical) {
+  return physical == parquet::Type::INT32 ||
+    physical == parquet::Type::INT64 ||
+    physical == parquet::Type::FLOAT ||
+    physical == parquet::Type::DOUBLE ||
+    physical == parquet::Type::BYTE_ARRAY ||
+    physical == parquet::Type::FIXED_LEN_BYTE_ARRAY;
+}
+
+void BloomFilter::insert(uint64_t hash) {
+  size_t numBlocks = bitset.size() / BYTES_PER_BLOCK;
+  uint8_t* block = &bitset[((hash >> 32) * numBlocks >> 32) * BYTES_PER_BLOCK];
+  uint32_t key = (uint32_t)hash;
+  for(int i = 0; i < 8; i++) {
+    uint32_t word = read32(block + i * 4);
+    word |= 1U << ((key * SALT[i]) >> 27);
+    memcpy(block + i * 4, &word, sizeof(word));
+  }
+}
+
+bool BloomFilter::mightContain(uint64_t hash) const {
+  size_t numBlocks = bitset.size() / BYTES_PER_BLOCK;
+  const uint8_t* block = &bitset[((hash >> 32) * numBlocks >> 32) * BYTES_PER_BLOCK];
+  uint32_t key = (uint32_t)hash;
+  for(int i = 0; i < 8; i++) {
+    if(!(read32(block + i * 4) & (1U << ((key * SALT[i]) >> 27))))
+      return false;
+  }
+  return true;
+}
+
+bool BloomFilter::mightContainInteger(parquet::Type::type physical, int64_t value) const {
+  if(physical == parquet::Type::INT32) {
+    if(value < INT32_MIN || value > INT32_MAX)
+      return false;
+    int32_t v = value;
+    return mightContain(xxHash64(&v, sizeof(v)));
+  }
+
+  if(physical == parquet::Type::INT64)
+    return mightContain(xxHash64(&value, sizeof(value)));
+
+  return true;
+}
+
+// The value's own bit pattern, that is
+static bool mightContainBits(const BloomFilter& filter, parquet::Type::type physical, double value) {
+  if(physical == parquet::Type::FLOAT) {
+    float v = value;
+    if(v != value)
+      return false;
+    return filter.mightContain(xxHash64(&v, sizeof(v)));
+  }
+
+  if(physical == parquet::Type::DOUBLE)
+    return filter.mightContain(xxHash64(&value, sizeof(value)));
+
+  return true;
+}
+
+bool BloomFilter::mightContainDouble(parquet::Type::type physical, double value) const {
+  // -0.0 and 0.0 are equal, but hash differently
+  if(value == 0)
+    return mightContainBits(*this, physical, 0.0) || mightContainBits(*this, physical, -0.0);
+
+  return mightContainBits(*this, physical, value);
+}
+
+bool BloomFilter::mightContainBytes(parquet::Type::type physical, const uint8_t* data, size_t len) const {
+  if(physical == parquet::Type::BYTE_ARRAY || physical == parquet::Type::FIXED_LEN_BYTE_ARRAY)
+    return mightContain(xxHash64(data, len));
+
+  return true;
+}
+
+const std::vector<uint8_t>& BloomFilter::getBitset() const {
+  return bitset;
+}
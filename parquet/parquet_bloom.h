@@ -0,0 +1,47 @@
+#ifndef PARQUET_BLOOM_H
+#define PARQUET_BLOOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parquet/api/reader.h"
+
+// xxHash64 with a seed of 0, as Parquet's bloom filters use
+uint64_t xxHash64(const void* data, size_t len);
+
+// A split-block bloom filter, laid out as the Parquet format specifies so
+// that filters read from files and filters we build work the same way: an
+// array of 32-byte blocks of eight little-endian 32-bit words, each value
+// setting one bit in each word of one block.
+//
+// Values are hashed in their plain encoding: 4 bytes for INT32 and FLOAT,
+// 8 for INT64 and DOUBLE, and just the bytes for BYTE_ARRAY and
+// FIXED_LEN_BYTE_ARRAY.
+class BloomFilter {
+  std::vector<uint8_t> bitset;
+
+public:
+  // bitset must be a whole number of blocks
+  explicit BloomFilter(std::vector<uint8_t> bitset);
+
+  // An empty filter with a false positive rate of about 1% once it holds
+  // numDistinct values
+  static BloomFilter sized(size_t numDistinct);
+
+  // Whether a column of this physical type can have a filter we can use
+  static bool supports(parquet::Type::type physical);
+
+  void insert(uint64_t hash);
+  bool mightContain(uint64_t hash) const;
+
+  // Whether a column of the given physical type might hold a value equal,
+  // as SQLite compares, to value. True for types the value can't be hashed
+  // as; false if the type can't represent the value at all.
+  bool mightContainInteger(parquet::Type::type physical, int64_t value) const;
+  bool mightContainDouble(parquet::Type::type physical, double value) const;
+  bool mightContainBytes(parquet::Type::type physical, const uint8_t* data, size_t len) const;
+
+  const std::vector<uint8_t>& getBitset() const;
+};
+
+#endif
@@ -1,14 +1,44 @@
 #include "parquet_cursor.h"
+#include "parquet_simd.h"
 
-ParquetCursor::ParquetCursor(ParquetTable* table): table(table) {
+#include <atomic>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// How many values we decode from a column at a time.
+static const int64_t BATCH_SIZE = 4096;
+
+// Decoded column chunks kept for scans to share, unless configured otherwise
+static const size_t DEFAULT_COLUMN_CACHE_BYTES = 64 * 1024 * 1024;
+
+// Don't bother prefetching row groups whose wanted column chunks are smaller
+// than this; the thread would cost more than the read it hides.
+static const int64_t PREFETCH_MIN_BYTES = 64 * 1024;
+
+ParquetCursor::ParquetCursor(ParquetTable* table): table(table), conjunction(0) {
   reader = NULL;
-  reset(std::vector<Constraint>());
+  readerFile = -1;
+  recordingLimit = 0;
+  columnChunksRead = 0;
+  compressedBytesRead = 0;
+  defLevels.resize(BATCH_SIZE);
+  constraintMatches.resize(BATCH_SIZE);
+  rowIdScratch.resize(BATCH_SIZE);
+  noNulls.resize(BATCH_SIZE, 0);
+  // Large enough for BATCH_SIZE of the widest type we widen, INT96
+  scratch.resize(BATCH_SIZE * sizeof(parquet::Int96));
+  reset(std::vector<Constraint>(), RowGroupBitmap(0), -1, 0, std::vector<unsigned char>());
 }
 
-bool ParquetCursor::currentRowGroupSatisfiesRowIdFilter(Constraint& constraint) {
+// firstRowId is the rowid of the row group's first row.
+bool ParquetCursor::rowGroupSatisfiesRowIdFilter(Constraint& constraint, int firstRowId, int numRows) {
   if(constraint.type != Integer)
     return true;
 
+  int rowId = firstRowId;
+  int rowGroupSize = numRows;
+
   int64_t target = constraint.intValue;
   switch(constraint.op) {
     case IsNull:
@@ -16,12 +46,18 @@ bool ParquetCursor::currentRowGroupSatisfiesRowIdFilter(Constraint& constraint)
     case Is:
     case Equal:
       return target >= rowId && target < rowId + rowGroupSize;
+    case In:
+    {
+      const std::vector<int64_t>& values = constraint.intValues;
+      std::vector<int64_t>::const_iterator it = std::lower_bound(values.begin(), values.end(), rowId);
+      return it != values.end() && *it < rowId + rowGroupSize;
+    }
     case GreaterThan:
-      // rowId > target
-      return rowId + rowGroupSize > target;
+      // The last rowId > target
+      return rowId + rowGroupSize - 1 > target;
     case GreaterThanOrEqual:
-      // rowId >= target
-      return rowId + rowGroupSize >= rowId;
+      // The last rowId >= target
+      return rowId + rowGroupSize - 1 >= target;
     case LessThan:
       return target > rowId;
     case LessThanOrEqual:
@@ -31,7 +67,7 @@ bool ParquetCursor::currentRowGroupSatisfiesRowIdFilter(Constraint& constraint)
   }
 }
 
-bool ParquetCursor::currentRowGroupSatisfiesBlobFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
+bool ParquetCursor::rowGroupSatisfiesBlobFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
   if(!_stats->HasMinMax()) {
     return true;
   }
@@ -64,7 +100,7 @@ bool ParquetCursor::currentRowGroupSatisfiesBlobFilter(Constraint& constraint, s
   } else {
     // Should be impossible to get here
     std::ostringstream ss;
-    ss << __FILE__ << ":" << __LINE__ << ": currentRowGroupSatisfiesBlobFilter called on unsupported type: " <<
+    ss << __FILE__ << ":" << __LINE__ << ": rowGroupSatisfiesBlobFilter called on unsupported type: " <<
       parquet::TypeToString(pqType);
     throw std::invalid_argument(ss.str());
   }
@@ -137,7 +173,7 @@ bool ParquetCursor::currentRowGroupSatisfiesBlobFilter(Constraint& constraint, s
   }
 }
 
-bool ParquetCursor::currentRowGroupSatisfiesTextFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
+bool ParquetCursor::rowGroupSatisfiesTextFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
   parquet::TypedRowGroupStatistics<parquet::DataType<parquet::Type::BYTE_ARRAY>>* stats =
     (parquet::TypedRowGroupStatistics<parquet::DataType<parquet::Type::BYTE_ARRAY>>*)_stats.get();
 
@@ -160,6 +196,12 @@ bool ParquetCursor::currentRowGroupSatisfiesTextFilter(Constraint& constraint, s
     case Is:
     case Equal:
       return str >= minStr && str <= maxStr;
+    case In:
+    {
+      const std::vector<std::string>& values = constraint.stringValues;
+      std::vector<std::string>::const_iterator it = std::lower_bound(values.begin(), values.end(), minStr);
+      return it != values.end() && *it <= maxStr;
+    }
     case GreaterThanOrEqual:
       return maxStr >= str;
     case GreaterThan:
@@ -195,7 +237,7 @@ int64_t int96toMsSinceEpoch(const parquet::Int96& rv) {
   return nsSinceEpoch;
 }
 
-bool ParquetCursor::currentRowGroupSatisfiesIntegerFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
+bool ParquetCursor::rowGroupSatisfiesIntegerFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
   if(!_stats->HasMinMax()) {
     return true;
   }
@@ -240,7 +282,7 @@ bool ParquetCursor::currentRowGroupSatisfiesIntegerFilter(Constraint& constraint
     // Should be impossible to get here as we should have forbidden this at
     // CREATE time -- maybe file changed underneath us?
     std::ostringstream ss;
-    ss << __FILE__ << ":" << __LINE__ << ": currentRowGroupSatisfiesIntegerFilter called on unsupported type: " <<
+    ss << __FILE__ << ":" << __LINE__ << ": rowGroupSatisfiesIntegerFilter called on unsupported type: " <<
       parquet::TypeToString(pqType);
     throw std::invalid_argument(ss.str());
   }
@@ -252,6 +294,12 @@ bool ParquetCursor::currentRowGroupSatisfiesIntegerFilter(Constraint& constraint
     case Is:
     case Equal:
       return value >= min && value <= max;
+    case In:
+    {
+      const std::vector<int64_t>& values = constraint.intValues;
+      std::vector<int64_t>::const_iterator it = std::lower_bound(values.begin(), values.end(), min);
+      return it != values.end() && *it <= max;
+    }
     case GreaterThanOrEqual:
       return max >= value;
     case GreaterThan:
@@ -272,7 +320,7 @@ bool ParquetCursor::currentRowGroupSatisfiesIntegerFilter(Constraint& constraint
   return true;
 }
 
-bool ParquetCursor::currentRowGroupSatisfiesDoubleFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
+bool ParquetCursor::rowGroupSatisfiesDoubleFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> _stats) {
   if(!_stats->HasMinMax()) {
     return true;
   }
@@ -303,7 +351,7 @@ bool ParquetCursor::currentRowGroupSatisfiesDoubleFilter(Constraint& constraint,
     // Should be impossible to get here as we should have forbidden this at
     // CREATE time -- maybe file changed underneath us?
     std::ostringstream ss;
-    ss << __FILE__ << ":" << __LINE__ << ": currentRowGroupSatisfiesIntegerFilter called on unsupported type: " <<
+    ss << __FILE__ << ":" << __LINE__ << ": rowGroupSatisfiesIntegerFilter called on unsupported type: " <<
       parquet::TypeToString(pqType);
     throw std::invalid_argument(ss.str());
   }
@@ -315,6 +363,12 @@ bool ParquetCursor::currentRowGroupSatisfiesDoubleFilter(Constraint& constraint,
     case Is:
     case Equal:
       return value >= min && value <= max;
+    case In:
+    {
+      const std::vector<double>& values = constraint.doubleValues;
+      std::vector<double>::const_iterator it = std::lower_bound(values.begin(), values.end(), min);
+      return it != values.end() && *it <= max;
+    }
     case GreaterThanOrEqual:
       return max >= value;
     case GreaterThan:
@@ -336,28 +390,42 @@ bool ParquetCursor::currentRowGroupSatisfiesDoubleFilter(Constraint& constraint,
 
 }
 
-bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
-  if(constraint.type != Text) {
-    return true;
+// Orders a list's strings against a value, bytewise, as SQLite's BINARY
+// collation does.
+struct StringLessThanByteArray {
+  bool operator()(const std::string& str, const parquet::ByteArray* ba) const {
+    return std::lexicographical_compare(
+        (const unsigned char*)str.data(),
+        (const unsigned char*)str.data() + str.size(),
+        ba->ptr,
+        ba->ptr + ba->len);
   }
+};
 
-  parquet::ByteArray* ba = getByteArray(constraint.column);
+// Return true if the value satisfies a text constraint. Only called for
+// non-null values.
+static bool textSatisfies(const Constraint& constraint, const parquet::ByteArray* ba) {
+  const std::vector<unsigned char>& blob = constraint.blobValue;
 
   switch(constraint.op) {
+    case In:
+    {
+      const std::vector<std::string>& values = constraint.stringValues;
+      std::vector<std::string>::const_iterator it =
+        std::lower_bound(values.begin(), values.end(), ba, StringLessThanByteArray());
+      return it != values.end() && it->size() == ba->len && 0 == memcmp(it->data(), ba->ptr, ba->len);
+    }
     case Is:
     case Equal:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       if(blob.size() != ba->len)
         return false;
 
       return 0 == memcmp(&blob[0], ba->ptr, ba->len);
     }
+    case IsNot:
     case NotEqual:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       if(blob.size() != ba->len)
         return true;
 
@@ -365,8 +433,6 @@ bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
     }
     case GreaterThan:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       return std::lexicographical_compare(
           &blob[0],
           &blob[0] + blob.size(),
@@ -375,8 +441,6 @@ bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
     }
     case GreaterThanOrEqual:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       bool equal = blob.size() == ba->len && 0 == memcmp(&blob[0], ba->ptr, ba->len);
 
       return equal || std::lexicographical_compare(
@@ -387,8 +451,6 @@ bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
     }
     case LessThan:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       return std::lexicographical_compare(
           ba->ptr,
           ba->ptr + ba->len,
@@ -397,8 +459,6 @@ bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
     }
     case LessThanOrEqual:
     {
-      const std::vector<unsigned char>& blob = constraint.blobValue;
-
       bool equal = blob.size() == ba->len && 0 == memcmp(&blob[0], ba->ptr, ba->len);
 
       return equal || std::lexicographical_compare(
@@ -418,95 +478,294 @@ bool ParquetCursor::currentRowSatisfiesTextFilter(Constraint& constraint) {
         len = likeStringValue.size();
       return 0 == memcmp(&likeStringValue[0], ba->ptr, len);
     }
-    case IsNot:
     default:
       return true;
   }
 }
 
-bool ParquetCursor::currentRowSatisfiesIntegerFilter(Constraint& constraint) {
-  if(constraint.type != Integer) {
-    return true;
+void ParquetCursor::filterTextBlock(Constraint& constraint, DictionaryMatches& cache, int firstRow, int numRows, unsigned char* matches) {
+  if(constraint.type != Text) {
+    memset(matches, 1, numRows);
+    return;
   }
 
-  int column = constraint.column;
+  const ColumnBatch& batch = batches[constraint.column];
+  const parquet::ByteArray* values = &batch.byteArrayValues[firstRow - batch.startRow];
+  const unsigned char* nulls = &batch.nulls[firstRow - batch.startRow];
+  bool nullMatches = constraint.op == IsNot;
+
+  // Plain-encoded values point into the page buffer, which gets reused, so
+  // their addresses say nothing about their contents.
+  if(!batch.dictionaryEncoded) {
+    switch(constraint.op) {
+      case Is:
+      case Equal:
+      case IsNot:
+      case NotEqual:
+        filterKernels().compareBytes(values, nulls, numRows, constraint.op,
+            constraint.blobValue.data(), constraint.blobValue.size(), matches);
+        return;
+      case Like:
+        filterKernels().matchPrefix(values, nulls, numRows,
+            (const uint8_t*)constraint.likeStringValue.data(), constraint.likeStringValue.size(), matches);
+        return;
+      default:
+        break;
+    }
 
-  // CONSIDER: should we just store int64s everywhere?
-  int64_t value = 0;
+    for(int i = 0; i < numRows; i++) {
+      matches[i] = nulls[i] ? nullMatches : textSatisfies(constraint, &values[i]);
+    }
+    return;
+  }
 
-  if(column == -1) {
-    value = rowId;
-  } else {
-    parquet::Type::type pqType = types[column];
+  // Dictionary-encoded: evaluate each distinct value once. Runs of the same
+  // value are common, so check the previous row before the cache.
+  const uint8_t* lastPtr = NULL;
+  uint32_t lastLen = 0;
+  unsigned char lastMatch = 0;
+  for(int i = 0; i < numRows; i++) {
+    if(nulls[i]) {
+      matches[i] = nullMatches;
+      continue;
+    }
 
-    if(pqType == parquet::Type::INT32 || pqType == parquet::Type::BOOLEAN) {
-      value = getInt32(column);
-    } else if(pqType == parquet::Type::INT64 || pqType == parquet::Type::INT96) {
-      value = getInt64(column);
-    } else {
-      // Should be impossible to get here
-      std::ostringstream ss;
-      ss << __FILE__ << ":" << __LINE__ << ": currentRowSatisfiesIntegerFilter called on unsupported type: " <<
-        parquet::TypeToString(pqType);
-      throw std::invalid_argument(ss.str());
+    const parquet::ByteArray& ba = values[i];
+    if(ba.ptr != lastPtr || ba.len != lastLen || lastPtr == NULL) {
+      int cached = cache.lookup(ba);
+      if(cached == -1) {
+        cached = textSatisfies(constraint, &ba);
+        cache.insert(ba, cached);
+      }
+      lastPtr = ba.ptr;
+      lastLen = ba.len;
+      lastMatch = cached;
     }
+    matches[i] = lastMatch;
   }
+}
 
-  int64_t constraintValue = constraint.intValue;
+DictionaryMatches::DictionaryMatches(): used(0) {
+}
 
-  switch(constraint.op) {
-    case Is:
-    case Equal:
-      return constraintValue == value;
-    case NotEqual:
-      return constraintValue != value;
-    case GreaterThan:
-      return value > constraintValue;
-    case GreaterThanOrEqual:
-      return value >= constraintValue;
-    case LessThan:
-      return value < constraintValue;
-    case LessThanOrEqual:
-      return value <= constraintValue;
-    case Like:
-    case IsNot:
-    default:
-      return true;
+size_t DictionaryMatches::slotFor(const uint8_t* ptr, uint32_t len) const {
+  size_t mask = ptrs.size() - 1;
+  size_t slot = (((uint64_t)(uintptr_t)ptr + len) * 0x9E3779B97F4A7C15ULL >> 20) & mask;
+  while(ptrs[slot] != NULL && (ptrs[slot] != ptr || lens[slot] != len))
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+int DictionaryMatches::lookup(const parquet::ByteArray& ba) const {
+  if(used == 0)
+    return -1;
+
+  size_t slot = slotFor(ba.ptr, ba.len);
+  if(ptrs[slot] == NULL)
+    return -1;
+  return results[slot];
+}
+
+void DictionaryMatches::insert(const parquet::ByteArray& ba, bool result) {
+  // Empty strings may not have a pointer; they're cheap to evaluate anyway
+  if(ba.ptr == NULL)
+    return;
+
+  if((used + 1) * 2 > ptrs.size())
+    grow();
+
+  size_t slot = slotFor(ba.ptr, ba.len);
+  if(ptrs[slot] == NULL)
+    used++;
+  ptrs[slot] = ba.ptr;
+  lens[slot] = ba.len;
+  results[slot] = result;
+}
+
+void DictionaryMatches::grow() {
+  std::vector<const uint8_t*> oldPtrs;
+  std::vector<uint32_t> oldLens;
+  std::vector<unsigned char> oldResults;
+  oldPtrs.swap(ptrs);
+  oldLens.swap(lens);
+  oldResults.swap(results);
+
+  size_t size = oldPtrs.empty() ? 1024 : oldPtrs.size() * 2;
+  ptrs.assign(size, NULL);
+  lens.assign(size, 0);
+  results.assign(size, 0);
+
+  for(size_t i = 0; i < oldPtrs.size(); i++) {
+    if(oldPtrs[i] == NULL)
+      continue;
+    size_t slot = slotFor(oldPtrs[i], oldLens[i]);
+    ptrs[slot] = oldPtrs[i];
+    lens[slot] = oldLens[i];
+    results[slot] = oldResults[i];
   }
+}
 
-  return true;
+void DictionaryMatches::clear() {
+  if(used == 0)
+    return;
+  std::fill(ptrs.begin(), ptrs.end(), (const uint8_t*)NULL);
+  used = 0;
 }
 
-bool ParquetCursor::currentRowSatisfiesDoubleFilter(Constraint& constraint) {
-  if(constraint.type != Double) {
-    return true;
+// Each buffer is a header, then the value's bytes, then a NUL
+struct StableValueHeader {
+  std::atomic<int> refs;
+  uint32_t len;
+  bool hasNul;
+};
+
+static StableValueHeader* stableValueHeader(const char* value) {
+  return (StableValueHeader*)(value - sizeof(StableValueHeader));
+}
+
+size_t StableDictionary::KeyHash::operator()(const std::pair<const uint8_t*, uint32_t>& key) const {
+  return std::hash<const uint8_t*>()(key.first) ^ key.second;
+}
+
+StableDictionary::StableDictionary() {
+}
+
+StableDictionary::StableDictionary(StableDictionary&& other) {
+  values.swap(other.values);
+}
+
+StableDictionary::~StableDictionary() {
+  clear();
+}
+
+const char* StableDictionary::acquire(const parquet::ByteArray& ba) {
+  std::pair<const uint8_t*, uint32_t> key(ba.ptr, ba.len);
+  std::unordered_map<std::pair<const uint8_t*, uint32_t>, char*, KeyHash>::iterator it = values.find(key);
+  char* value;
+  if(it != values.end()) {
+    value = it->second;
+  } else {
+    char* buffer = new char[sizeof(StableValueHeader) + ba.len + 1];
+    StableValueHeader* header = new(buffer) StableValueHeader();
+    header->refs = 1;
+    header->len = ba.len;
+    value = buffer + sizeof(StableValueHeader);
+    if(ba.len > 0)
+      memcpy(value, ba.ptr, ba.len);
+    value[ba.len] = '\0';
+    header->hasNul = strlen(value) != ba.len;
+    values[key] = value;
+  }
+
+  stableValueHeader(value)->refs++;
+  return value;
+}
+
+void StableDictionary::clear() {
+  if(values.empty())
+    return;
+  for(std::unordered_map<std::pair<const uint8_t*, uint32_t>, char*, KeyHash>::iterator it = values.begin();
+      it != values.end();
+      it++)
+    releaseStableValue(it->second);
+  values.clear();
+}
+
+bool StableDictionary::hasNul(const char* value) {
+  return stableValueHeader(value)->hasNul;
+}
+
+void releaseStableValue(void* value) {
+  StableValueHeader* header = stableValueHeader((const char*)value);
+  if(--header->refs > 0)
+    return;
+  header->~StableValueHeader();
+  delete[] (char*)header;
+}
+
+// The kernels only do comparisons with a single value; probe each non-null
+// value against the list's sorted values instead.
+template<typename T>
+static void filterInBlock(const std::vector<T>& values, const T* data, const unsigned char* nulls, int numRows, unsigned char* matches) {
+  for(int i = 0; i < numRows; i++)
+    matches[i] = !nulls[i] && std::binary_search(values.begin(), values.end(), data[i]);
+}
+
+void ParquetCursor::filterIntegerBlock(Constraint& constraint, int firstRow, int numRows, unsigned char* matches) {
+  if(constraint.type != Integer) {
+    memset(matches, 1, numRows);
+    return;
   }
 
   int column = constraint.column;
-  double value = getDouble(column);
-  double constraintValue = constraint.doubleValue;
 
-  switch(constraint.op) {
-    case Is:
-    case Equal:
-      return constraintValue == value;
-    case NotEqual:
-      return constraintValue != value;
-    case GreaterThan:
-      return value > constraintValue;
-    case GreaterThanOrEqual:
-      return value >= constraintValue;
-    case LessThan:
-      return value < constraintValue;
-    case LessThanOrEqual:
-      return value <= constraintValue;
-    case Like:
-    case IsNot:
-    default:
-      return true;
+  if(column == -1) {
+    for(int i = 0; i < numRows; i++)
+      rowIdScratch[i] = firstRow + i;
+
+    if(constraint.op == In)
+      filterInBlock(constraint.intValues, &rowIdScratch[0], &noNulls[0], numRows, matches);
+    else
+      filterKernels().compareInt64(&rowIdScratch[0], &noNulls[0], numRows, constraint.op, constraint.intValue, matches);
+    return;
   }
 
-  return true;
+  parquet::Type::type pqType = types[column];
+  if(pqType != parquet::Type::INT32 &&
+      pqType != parquet::Type::INT64 &&
+      pqType != parquet::Type::INT96 &&
+      pqType != parquet::Type::BOOLEAN) {
+    // Should be impossible to get here
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": filterIntegerBlock called on unsupported type: " <<
+      parquet::TypeToString(pqType);
+    throw std::invalid_argument(ss.str());
+  }
+
+  const ColumnBatch& batch = batches[column];
+  if(constraint.op == In) {
+    filterInBlock(
+        constraint.intValues,
+        &batch.intValues[firstRow - batch.startRow],
+        &batch.nulls[firstRow - batch.startRow],
+        numRows,
+        matches);
+    return;
+  }
+
+  filterKernels().compareInt64(
+      &batch.intValues[firstRow - batch.startRow],
+      &batch.nulls[firstRow - batch.startRow],
+      numRows,
+      constraint.op,
+      constraint.intValue,
+      matches);
+}
+
+void ParquetCursor::filterDoubleBlock(Constraint& constraint, int firstRow, int numRows, unsigned char* matches) {
+  if(constraint.type != Double) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  const ColumnBatch& batch = batches[constraint.column];
+  if(constraint.op == In) {
+    filterInBlock(
+        constraint.doubleValues,
+        &batch.doubleValues[firstRow - batch.startRow],
+        &batch.nulls[firstRow - batch.startRow],
+        numRows,
+        matches);
+    return;
+  }
+
+  filterKernels().compareDouble(
+      &batch.doubleValues[firstRow - batch.startRow],
+      &batch.nulls[firstRow - batch.startRow],
+      numRows,
+      constraint.op,
+      constraint.doubleValue,
+      matches);
 }
 
 
@@ -517,386 +776,1508 @@ bool ParquetCursor::currentRowSatisfiesDoubleFilter(Constraint& constraint) {
 // This avoids opening rowgroups that can't return useful
 // data, which provides substantial performance benefits.
 bool ParquetCursor::currentRowGroupSatisfiesFilter() {
-  for(unsigned int i = 0; i < constraints.size(); i++) {
-    int column = constraints[i].column;
-    int op = constraints[i].op;
-    bool rv = true;
-
-    if(column == -1) {
-      rv = currentRowGroupSatisfiesRowIdFilter(constraints[i]);
-    } else {
-      std::unique_ptr<parquet::ColumnChunkMetaData> md = rowGroupMetadata->ColumnChunk(column);
-      if(md->is_stats_set()) {
-        std::shared_ptr<parquet::RowGroupStatistics> stats = md->statistics();
-
-        // SQLite is much looser with types than you might expect if you
-        // come from a Postgres background. The constraint '30.0' (that is,
-        // a string containing a floating point number) should be treated
-        // as equal to a field containing an integer 30.
-        //
-        // This means that even if the parquet physical type is integer,
-        // the constraint type may be a string, so dispatch to the filter
-        // fn based on the Parquet type.
-
-        if(op == IsNull) {
-          rv = stats->null_count() > 0;
-        } else if(op == IsNotNull) {
-          rv = stats->num_values() > 0;
-        } else {
-          parquet::Type::type pqType = types[column];
-
-          if(pqType == parquet::Type::BYTE_ARRAY && logicalTypes[column] == parquet::LogicalType::UTF8) {
-            rv = currentRowGroupSatisfiesTextFilter(constraints[i], stats);
-          } else if(pqType == parquet::Type::BYTE_ARRAY) {
-            rv = currentRowGroupSatisfiesBlobFilter(constraints[i], stats);
-          } else if(pqType == parquet::Type::INT32 ||
-                    pqType == parquet::Type::INT64 ||
-                    pqType == parquet::Type::INT96 ||
-                    pqType == parquet::Type::BOOLEAN) {
-            rv = currentRowGroupSatisfiesIntegerFilter(constraints[i], stats);
-          } else if(pqType == parquet::Type::FLOAT || pqType == parquet::Type::DOUBLE) {
-            rv = currentRowGroupSatisfiesDoubleFilter(constraints[i], stats);
-          }
-        }
-      }
-    }
+  int rejectedBy = rowGroupRejectedBy(rowGroupId, *rowGroupMetadata, rowId);
+  if(rejectedBy == -1)
+    return true;
 
-    // and it with the existing actual, which may have come from a previous run
-    rv = rv && constraints[i].bitmap.getActualMembership(rowGroupId);
-    if(!rv) {
-      constraints[i].bitmap.setEstimatedMembership(rowGroupId, rv);
-      constraints[i].bitmap.setActualMembership(rowGroupId, rv);
-      return rv;
-    }
+  conjunction.setEstimatedMembership(rowGroupId, false);
+  conjunction.setActualMembership(rowGroupId, false);
+  if(rejectedBy < (int)constraints.size()) {
+    constraints[rejectedBy].bitmap.setEstimatedMembership(rowGroupId, false);
+    constraints[rejectedBy].bitmap.setActualMembership(rowGroupId, false);
   }
-
-//  printf("rowGroup %d %s\n", rowGroupId, overallRv ? "may satisfy" : "does not satisfy");
-  return true;
+  return false;
 }
 
+// Return false if the row group's metadata proves that none of its rows
+// satisfy the constraint. firstRowId is the rowid of its first row.
+bool ParquetCursor::statisticsAdmit(
+    Constraint& constraint,
+    int group,
+    const parquet::RowGroupMetaData& metadata,
+    int firstRowId) {
+  int column = constraint.column;
+  int op = constraint.op;
 
-bool ParquetCursor::nextRowGroup() {
-start:
-  // Ensure that rowId points at the start of this rowGroup (eg, in the case where
-  // we skipped an entire row group).
-  rowId = rowGroupStartRowId + rowGroupSize;
-
-  if((rowGroupId + 1) >= numRowGroups) {
+  if(constraint.type == Null && op != IsNull && op != IsNotNull && op != Is && op != IsNot)
     return false;
-  }
 
-  while(table->getNumColumns() >= scanners.size()) {
-    scanners.push_back(std::shared_ptr<parquet::Scanner>());
-    // If it doesn't exist, it's the rowId as of the last nextRowGroup call
-    colRows.push_back(rowGroupStartRowId);
-    colNulls.push_back(false);
-    colIntValues.push_back(0);
-    colDoubleValues.push_back(0);
-    colByteArrayValues.push_back(parquet::ByteArray());
-  }
+  if(column == -1)
+    return rowGroupSatisfiesRowIdFilter(constraint, firstRowId, metadata.num_rows());
 
+  if(table->isPartitionColumn(column))
+    return partitionSatisfies(constraint, table->getRowGroupFile(group));
 
-  rowGroupStartRowId = rowId;
-  rowGroupId++;
-  rowGroupMetadata = reader->metadata()->RowGroup(rowGroupId);
-  rowGroupSize = rowsLeftInRowGroup = rowGroupMetadata->num_rows();
-  rowGroup = reader->RowGroup(rowGroupId);
-  for(unsigned int i = 0; i < scanners.size(); i++)
-    scanners[i] = NULL;
+  std::unique_ptr<parquet::ColumnChunkMetaData> md = metadata.ColumnChunk(column);
+  if(!md->is_stats_set())
+    return true;
 
-  while(types.size() < (unsigned int)rowGroupMetadata->num_columns()) {
-    types.push_back(rowGroupMetadata->schema()->Column(0)->physical_type());
-  }
+  return columnStatisticsAdmit(constraint, md->statistics());
+}
 
-  while(logicalTypes.size() < (unsigned int)rowGroupMetadata->num_columns()) {
-    logicalTypes.push_back(rowGroupMetadata->schema()->Column(0)->logical_type());
-  }
+// Whether a file's value of a partition column satisfies the constraint.
+// Every row of the file has that value, so this is exact.
+bool ParquetCursor::partitionSatisfies(const Constraint& constraint, int file) {
+  const std::string* value = table->getPartitionValue(file, constraint.column);
+  int op = constraint.op;
+
+  if(op == IsNull)
+    return value == NULL;
+  if(op == IsNotNull)
+    return value != NULL;
+  // Other comparisons with null never get here
+  if(constraint.type == Null)
+    return (value == NULL) == (op == Is);
+  if(value == NULL)
+    return op == IsNot;
+  // As for text columns, SQLite checks other types of value itself
+  if(constraint.type != Text)
+    return true;
 
-  for(unsigned int i = 0; i < (unsigned int)rowGroupMetadata->num_columns(); i++) {
-    types[i] = rowGroupMetadata->schema()->Column(i)->physical_type();
-    logicalTypes[i] = rowGroupMetadata->schema()->Column(i)->logical_type();
-  }
+  parquet::ByteArray ba(value->size(), (const uint8_t*)value->data());
+  return textSatisfies(constraint, &ba);
+}
 
-  for(unsigned int i = 0; i < colRows.size(); i++) {
-    colRows[i] = rowId;
+// Return false if statistics of some of the constraint's column's values,
+// be they a row group's or a page's, prove that none of them satisfy it.
+bool ParquetCursor::columnStatisticsAdmit(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats) {
+  int column = constraint.column;
+  int op = constraint.op;
+
+  // SQLite is much looser with types than you might expect if you
+  // come from a Postgres background. The constraint '30.0' (that is,
+  // a string containing a floating point number) should be treated
+  // as equal to a field containing an integer 30.
+  //
+  // This means that even if the parquet physical type is integer,
+  // the constraint type may be a string, so dispatch to the filter
+  // fn based on the Parquet type.
+
+  if(op == IsNull) {
+    // NaNs are null to us, but not to the writer's null_count
+    return stats->null_count() > 0 ||
+      types[column] == parquet::Type::FLOAT ||
+      types[column] == parquet::Type::DOUBLE;
   }
 
-  // Increment rowId so currentRowGroupSatisfiesRowIdFilter can access it;
-  // it'll get decremented by our caller
-  rowId++;
-
-  // We're going to scan this row group; reset the expectation of discovering
-  // a row
-  for(unsigned int i = 0; i < constraints.size(); i++) {
-    if(rowGroupId > 0 && constraints[i].rowGroupId == rowGroupId - 1) {
-      constraints[i].bitmap.setActualMembership(rowGroupId - 1, constraints[i].hadRows);
-    }
-    constraints[i].hadRows = false;
-  }
+  if(op == IsNotNull)
+    return stats->num_values() > 0;
 
-  if(!currentRowGroupSatisfiesFilter())
-    goto start;
+  parquet::Type::type pqType = types[column];
 
-  for(unsigned int i = 0; i < constraints.size(); i++) {
-    constraints[i].rowGroupId = rowGroupId;
+  if(pqType == parquet::Type::BYTE_ARRAY && logicalTypes[column] == parquet::LogicalType::UTF8) {
+    return rowGroupSatisfiesTextFilter(constraint, stats);
+  } else if(pqType == parquet::Type::BYTE_ARRAY) {
+    return rowGroupSatisfiesBlobFilter(constraint, stats);
+  } else if(pqType == parquet::Type::INT32 ||
+            pqType == parquet::Type::INT64 ||
+            pqType == parquet::Type::INT96 ||
+            pqType == parquet::Type::BOOLEAN) {
+    return rowGroupSatisfiesIntegerFilter(constraint, stats);
+  } else if(pqType == parquet::Type::FLOAT || pqType == parquet::Type::DOUBLE) {
+    return rowGroupSatisfiesDoubleFilter(constraint, stats);
   }
   return true;
 }
 
-// Return true if it is _possible_ that the current
-// row satisfies the constraints. Only return false
-// if it definitely does not.
-//
-// This avoids pointless transitions between the SQLite VM
-// and the extension, which can add up on a dataset of tens
-// of millions of rows.
-bool ParquetCursor::currentRowSatisfiesFilter() {
-  bool overallRv = true;
-  for(unsigned int i = 0; i < constraints.size(); i++) {
-    bool rv = true;
-    int column = constraints[i].column;
-    ensureColumn(column);
-    int op = constraints[i].op;
+template<typename DType>
+static std::shared_ptr<parquet::RowGroupStatistics> makeStatistics(
+    const parquet::ColumnDescriptor* descr,
+    const std::string& min,
+    const std::string& max,
+    int64_t numValues,
+    int64_t nullCount,
+    bool hasMinMax) {
+  return std::make_shared<parquet::TypedRowGroupStatistics<DType>>(
+      descr, min, max, numValues, nullCount, 0, hasMinMax);
+}
 
-    if(op == IsNull) {
-      rv = isNull(column);
-    } else if(op == IsNotNull) {
-      rv = !isNull(column);
-    } else {
+// Return false if what's known of a data page's values proves that none of
+// its numRows rows satisfy the constraint. nullCount is -1 if unknown; min
+// and max are plain-encoded.
+bool ParquetCursor::pageStatisticsAdmit(
+    Constraint& constraint,
+    int64_t numRows,
+    int64_t nullCount,
+    bool hasMinMax,
+    const std::string& min,
+    const std::string& max) {
+  int op = constraint.op;
+
+  // A page of nulls only satisfies tests for null
+  if(nullCount == numRows)
+    return op == IsNull ||
+      (op == Is && constraint.type == Null) ||
+      (op == IsNot && constraint.type != Null);
+
+  // Without a null count, assume there are both nulls and values
+  int64_t numValues = nullCount < 0 ? numRows : numRows - nullCount;
+  if(nullCount < 0)
+    nullCount = numRows;
+
+  const parquet::ColumnDescriptor* descr = rowGroupMetadata->schema()->Column(constraint.column);
+  std::shared_ptr<parquet::RowGroupStatistics> stats;
+  switch(types[constraint.column]) {
+    case parquet::Type::INT32:
+      stats = makeStatistics<parquet::DataType<parquet::Type::INT32>>(descr, min, max, numValues, nullCount, hasMinMax);
+      break;
+    case parquet::Type::INT64:
+      stats = makeStatistics<parquet::DataType<parquet::Type::INT64>>(descr, min, max, numValues, nullCount, hasMinMax);
+      break;
+    case parquet::Type::FLOAT:
+      stats = makeStatistics<parquet::DataType<parquet::Type::FLOAT>>(descr, min, max, numValues, nullCount, hasMinMax);
+      break;
+    case parquet::Type::DOUBLE:
+      stats = makeStatistics<parquet::DataType<parquet::Type::DOUBLE>>(descr, min, max, numValues, nullCount, hasMinMax);
+      break;
+    case parquet::Type::BYTE_ARRAY:
+      stats = makeStatistics<parquet::DataType<parquet::Type::BYTE_ARRAY>>(descr, min, max, numValues, nullCount, hasMinMax);
+      break;
+    default:
+      return true;
+  }
 
-      if(logicalTypes[column] == parquet::LogicalType::UTF8) {
-        rv = currentRowSatisfiesTextFilter(constraints[i]);
-      } else {
-        parquet::Type::type pqType = types[column];
-        if(pqType == parquet::Type::INT32 ||
-           pqType == parquet::Type::INT64 ||
-           pqType == parquet::Type::INT96 ||
-           pqType == parquet::Type::BOOLEAN) {
-          rv = currentRowSatisfiesIntegerFilter(constraints[i]);
-        } else if(pqType == parquet::Type::FLOAT || pqType == parquet::Type::DOUBLE) {
-          rv = currentRowSatisfiesDoubleFilter(constraints[i]);
-        }
-      }
-    }
+  return columnStatisticsAdmit(constraint, stats);
+}
 
-    // it defaults to false; so only set it if true
-    // ideally we'd short-circuit if we'd already set this group as visited
-    if(rv) {
-      constraints[i].hadRows = true;
+// Note the pages of the current row group that a page index proves hold no
+// rows satisfying some constraint, so the scan can pass over them in every
+// column without decoding them.
+void ParquetCursor::excludePages() {
+  excludedRows.clear();
+  excludedPos = 0;
+
+  int firstRowId = rowGroupStartRowId + 1;
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    if(constraints[i].column == -1)
+      continue;
+
+    const PageIndex* index = table->getPageIndex(constraints[i].column, rowGroupId);
+    if(index == NULL)
+      continue;
+
+    size_t numPages = index->firstRows.size();
+    for(size_t page = 0; page < numPages; page++) {
+      int64_t first = index->firstRows[page];
+      int64_t end = page + 1 < numPages ? index->firstRows[page + 1] : rowGroupSize;
+      if(first >= end)
+        continue;
+
+      int64_t nullCount = index->nullCounts.empty() ? -1 : index->nullCounts[page];
+      if(index->nullPages[page])
+        nullCount = end - first;
+
+      if(!pageStatisticsAdmit(
+            constraints[i],
+            end - first,
+            nullCount,
+            !index->nullPages[page],
+            index->minValues[page],
+            index->maxValues[page]))
+        excludedRows.push_back(std::make_pair(firstRowId + first, firstRowId + end));
     }
-    overallRv = overallRv && rv;
   }
-  return overallRv;
-}
 
-void ParquetCursor::next() {
-  // Returns true if we've crossed a row group boundary
-start:
-  if(rowsLeftInRowGroup == 0) {
-    if(!nextRowGroup()) {
-      // put rowId over the edge so eof returns true
-      rowId = numRows + 1;
-      return;
+  // Merge the constraints' ranges into one ordered list
+  std::sort(excludedRows.begin(), excludedRows.end());
+  size_t merged = 0;
+  for(size_t i = 0; i < excludedRows.size(); i++) {
+    if(merged > 0 && excludedRows[i].first <= excludedRows[merged - 1].second) {
+      if(excludedRows[i].second > excludedRows[merged - 1].second)
+        excludedRows[merged - 1].second = excludedRows[i].second;
     } else {
-      // After a successful nextRowGroup, rowId is pointing at the current row. Make it
-      // point before so the rest of the logic works out.
-      rowId--;
+      excludedRows[merged++] = excludedRows[i];
     }
   }
+  excludedRows.resize(merged);
+}
 
-  rowsLeftInRowGroup--;
-  rowId++;
-  if(constraints.size() > 0 && !currentRowSatisfiesFilter())
-    goto start;
+// Without a page index, the header of the data page a constrained column is
+// being read from may still rule out the rest of that page. Only numeric
+// columns' are trusted: writers used to order byte arrays' page statistics
+// as signed bytes.
+bool ParquetCursor::pageHeaderAdmits(Constraint& constraint) {
+  int column = constraint.column;
+  ParquetPageReader* pageReader = pageReaders[column];
+  if(pageReader == NULL || isDecoded(column))
+    return true;
+
+  parquet::Type::type pqType = types[column];
+  if(pqType != parquet::Type::INT32 &&
+      pqType != parquet::Type::INT64 &&
+      pqType != parquet::Type::FLOAT &&
+      pqType != parquet::Type::DOUBLE)
+    return true;
+
+  if(table->getPageIndex(column, rowGroupId) != NULL)
+    return true;
+
+  const parquet::EncodedStatistics& stats = pageReader->getPageStatistics();
+  return pageStatisticsAdmit(
+      constraint,
+      pageReader->getPageEndRow() - pageReader->getPageFirstRow(),
+      stats.has_null_count ? stats.null_count : -1,
+      stats.has_min && stats.has_max,
+      stats.min(),
+      stats.max());
 }
 
-int ParquetCursor::getRowId() {
+// The end of the excluded run of rows that rowId falls in, or rowId if it
+// isn't excluded. Only looks forward from the last call.
+int ParquetCursor::pastExcludedRows(int rowId) {
+  while(excludedPos < excludedRows.size() && excludedRows[excludedPos].second <= rowId)
+    excludedPos++;
+
+  if(excludedPos < excludedRows.size() && excludedRows[excludedPos].first <= rowId)
+    return excludedRows[excludedPos].second;
   return rowId;
 }
 
-bool ParquetCursor::eof() {
-  return rowId > numRows;
+// The first row at or after rowId that neither the rowid constraints nor
+// the excluded pages rule out.
+int ParquetCursor::nextCandidateRow(int rowId) {
+  while(true) {
+    int next = seeksRowIds ? nextCandidateRowId(rowId) : rowId;
+    next = pastExcludedRows(next);
+    if(next == rowId)
+      return rowId;
+    rowId = next;
+  }
 }
 
-void ParquetCursor::ensureColumn(int col) {
-  // -1 signals rowid, which is trivially available
-  if(col == -1)
-    return;
+// Return the index of a constraint that rules out the given row group, or
+// -1 if it may have matching rows. firstRowId is the rowid of its first row.
+//
+// This has no side effects, so it can be used to look ahead.
+int ParquetCursor::rowGroupRejectedBy(int group, const parquet::RowGroupMetaData& metadata, int firstRowId) {
+  if(!constraints.empty() && !conjunction.getActualMembership(group))
+    return constraints.size();
 
-  // need to ensure a scanner exists (and skip the # of rows in the rowgroup)
-  if(scanners[col].get() == NULL) {
-    std::shared_ptr<parquet::ColumnReader> colReader = rowGroup->Column(col);
-    scanners[col] = parquet::Scanner::Make(colReader);
-  }
-
-  // Actually fetch a value, stash data in colRows, colNulls, colValues
-  if(colRows[col] != rowId) {
-    // We may need to skip some records, eg, a query like
-    // SELECT a WHERE b = 10
-    // may have read b, but skipped a until b matches the predicate.
-    bool wasNull = false;
-    while(colRows[col] + 1 < rowId) {
-      switch(types[col]) {
-        case parquet::Type::INT32:
-        {
-          parquet::Int32Scanner* s = (parquet::Int32Scanner*)scanners[col].get();
-          int rv = 0;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::FLOAT:
-        {
-          parquet::FloatScanner* s = (parquet::FloatScanner*)scanners[col].get();
-          float rv = 0;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::DOUBLE:
-        {
-          parquet::DoubleScanner* s = (parquet::DoubleScanner*)scanners[col].get();
-          double rv = 0;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::BYTE_ARRAY:
-        {
-          parquet::ByteArrayScanner* s = (parquet::ByteArrayScanner*)scanners[col].get();
-          parquet::ByteArray ba;
-          s->NextValue(&ba, &wasNull);
-          break;
-        }
-        case parquet::Type::INT96:
-        {
-          parquet::Int96Scanner* s = (parquet::Int96Scanner*)scanners[col].get();
-          parquet::Int96 rv;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::INT64:
-        {
-          parquet::Int64Scanner* s = (parquet::Int64Scanner*)scanners[col].get();
-          long rv = 0;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::BOOLEAN:
-        {
-          parquet::BoolScanner* s = (parquet::BoolScanner*)scanners[col].get();
-          bool rv = false;
-          s->NextValue(&rv, &wasNull);
-          break;
-        }
-        case parquet::Type::FIXED_LEN_BYTE_ARRAY:
-        {
-          parquet::FixedLenByteArrayScanner* s = (parquet::FixedLenByteArrayScanner*)scanners[col].get();
-          parquet::FixedLenByteArray flba;
-          s->NextValue(&flba, &wasNull);
-          break;
-        }
-        default:
-          // Should be impossible to get here as we should have forbidden this at
-          // CREATE time -- maybe file changed underneath us?
-          std::ostringstream ss;
-          ss << __FILE__ << ":" << __LINE__ << ": column " << col << " has unsupported type: " <<
-            parquet::TypeToString(types[col]);
-          throw std::invalid_argument(ss.str());
-        break;
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    // Not part of statisticsAdmit: a bloom filter ruling out a row group
+    // in the middle of a run doesn't mean the run is over
+    bool rv = statisticsAdmit(constraints[i], group, metadata, firstRowId) &&
+      bloomFilterAdmits(constraints[i], group);
 
-      }
-      colRows[col]++;
-    }
+    // and it with the existing actual, which may have come from a previous run
+    rv = rv && constraints[i].bitmap.getActualMembership(group);
+    if(!rv)
+      return i;
+  }
 
-    colRows[col] = rowId;
-    wasNull = false;
+  return -1;
+}
 
-    bool hadValue = false;
-    switch(types[col]) {
-      case parquet::Type::INT32:
-      {
-        parquet::Int32Scanner* s = (parquet::Int32Scanner*)scanners[col].get();
-        int rv = 0;
-        hadValue = s->NextValue(&rv, &wasNull);
-        colIntValues[col] = rv;
-        break;
-      }
-      case parquet::Type::FLOAT:
-      {
-        parquet::FloatScanner* s = (parquet::FloatScanner*)scanners[col].get();
-        float rv = 0;
-        hadValue = s->NextValue(&rv, &wasNull);
-        colDoubleValues[col] = rv;
-        break;
-      }
-      case parquet::Type::DOUBLE:
-      {
-        parquet::DoubleScanner* s = (parquet::DoubleScanner*)scanners[col].get();
-        double rv = 0;
-        hadValue = s->NextValue(&rv, &wasNull);
-        colDoubleValues[col] = rv;
-        break;
-      }
-      case parquet::Type::BYTE_ARRAY:
-      {
-        parquet::ByteArrayScanner* s = (parquet::ByteArrayScanner*)scanners[col].get();
-        hadValue = s->NextValue(&colByteArrayValues[col], &wasNull);
-        break;
+// Return false if the column chunk's bloom filter proves that none of its
+// rows equal the constraint's value, or any of its values for IN.
+bool ParquetCursor::bloomFilterAdmits(const Constraint& constraint, int group) {
+  int column = constraint.column;
+  if(column == -1 || (constraint.op != Equal && constraint.op != Is && constraint.op != In))
+    return true;
+
+  const BloomFilter* filter = table->getBloomFilter(column, group);
+  if(filter == NULL)
+    return true;
+
+  parquet::Type::type physical = types[column];
+  bool utf8 = logicalTypes[column] == parquet::LogicalType::UTF8;
+  switch(constraint.type) {
+    case Integer:
+      if(constraint.op != In)
+        return filter->mightContainInteger(physical, constraint.intValue);
+      for(unsigned int i = 0; i < constraint.intValues.size(); i++)
+        if(filter->mightContainInteger(physical, constraint.intValues[i]))
+          return true;
+      return false;
+    case Double:
+      if(constraint.op != In)
+        return filter->mightContainDouble(physical, constraint.doubleValue);
+      for(unsigned int i = 0; i < constraint.doubleValues.size(); i++)
+        if(filter->mightContainDouble(physical, constraint.doubleValues[i]))
+          return true;
+      return false;
+    case Text:
+    case Blob:
+      // Text never equals a blob
+      if(utf8 != (constraint.type == Text))
+        return true;
+      if(constraint.op != In)
+        return filter->mightContainBytes(physical, constraint.blobValue.data(), constraint.blobValue.size());
+      for(unsigned int i = 0; i < constraint.stringValues.size(); i++) {
+        const std::string& value = constraint.stringValues[i];
+        if(filter->mightContainBytes(physical, (const uint8_t*)value.data(), value.size()))
+          return true;
       }
-      case parquet::Type::INT96:
+      return false;
+    default:
+      return true;
+  }
+}
+
+// The first rowid at or after rowId that no rowid constraint rules out, or
+// numRows + 1 if there isn't one. Rows from there on still need filtering.
+int ParquetCursor::nextCandidateRowId(int rowId) const {
+  const int64_t end = (int64_t)numRows + 1;
+  int64_t rv = rowId;
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    const Constraint& constraint = constraints[i];
+    if(constraint.column != -1 || constraint.type != Integer)
+      continue;
+
+    int64_t value = constraint.intValue;
+    int64_t bound = rowId;
+    switch(constraint.op) {
+      case Equal:
+      case Is:
+        bound = value >= rowId ? value : end;
+        break;
+      case GreaterThan:
+        bound = value < end ? value + 1 : end;
+        break;
+      case GreaterThanOrEqual:
+        bound = value;
+        break;
+      case LessThan:
+        if(rowId >= value)
+          bound = end;
+        break;
+      case LessThanOrEqual:
+        if(rowId > value)
+          bound = end;
+        break;
+      case In:
       {
-        // INT96 tracks a date with nanosecond precision, convert to ms since epoch.
-        // ...see https://github.com/apache/parquet-format/pull/49 for more
-        //
-        // First 8 bytes: nanoseconds into the day
-        // Last 4 bytes: Julian day
-        // To get nanoseconds since the epoch:
-        // (julian_day - 2440588) * (86400 * 1000 * 1000 * 1000) + nanoseconds
-        parquet::Int96Scanner* s = (parquet::Int96Scanner*)scanners[col].get();
-        parquet::Int96 rv {0, 0, 0};
-        hadValue = s->NextValue(&rv, &wasNull);
-        colIntValues[col] = int96toMsSinceEpoch(rv);
+        const std::vector<int64_t>& values = constraint.intValues;
+        std::vector<int64_t>::const_iterator it = std::lower_bound(values.begin(), values.end(), (int64_t)rowId);
+        bound = it == values.end() ? end : *it;
         break;
       }
-      case parquet::Type::INT64:
-      {
-        parquet::Int64Scanner* s = (parquet::Int64Scanner*)scanners[col].get();
-        long rv = 0;
-        hadValue = s->NextValue(&rv, &wasNull);
-        colIntValues[col] = rv;
+      default:
         break;
+    }
+
+    if(bound > rv)
+      rv = bound;
+  }
+
+  return rv > end ? end : rv;
+}
+
+// Whether a constraint can only be satisfied by a run of consecutive row
+// groups: a range, or an equality, on the rowid or on a column whose row
+// groups' values are ordered.
+bool ParquetCursor::matchesOneRun(const Constraint& constraint) {
+  switch(constraint.op) {
+    case Equal:
+    case Is:
+    case GreaterThan:
+    case GreaterThanOrEqual:
+    case LessThan:
+    case LessThanOrEqual:
+      break;
+    default:
+      return false;
+  }
+
+  if(constraint.type == Null)
+    return false;
+
+  return constraint.column == -1 || table->getColumnOrder(constraint.column).rowGroupOrder != 0;
+}
+
+// Whether the given row group, and so every one after it, is past the run of
+// row groups that can satisfy some constraint, in which case there's nothing
+// left to scan. inRun has a flag per constraint, set once the run has been
+// reached, and is updated for this row group.
+//
+// Only the statistics decide this: a row group in the run that turned out
+// to have no matching rows doesn't end it.
+bool ParquetCursor::pastMatchingRun(
+    int group,
+    const parquet::RowGroupMetaData& metadata,
+    int firstRowId,
+    std::vector<unsigned char>& inRun) {
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    if(!oneRun[i])
+      continue;
+
+    if(statisticsAdmit(constraints[i], group, metadata, firstRowId))
+      inRun[i] = 1;
+    else if(inRun[i])
+      return true;
+  }
+  return false;
+}
+
+
+// Note, in the constraints' bitmaps, which of them the row group just
+// scanned had rows for. Only a row group scanned to its end counts, and a
+// constraint is only marked as having none if every row was checked.
+void ParquetCursor::recordRowGroupResults() {
+  bool scanned = rowGroupId >= 0 && !constraints.empty() && constraints[0].rowGroupId == rowGroupId;
+  if(scanned && rowsLeftInRowGroup == 0)
+    conjunction.setActualMembership(rowGroupId, rowGroupHadRows);
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    if(rowGroupId < 0 || constraints[i].rowGroupId != rowGroupId)
+      continue;
+
+    if(rowsLeftInRowGroup == 0 && (constraints[i].hadRows || rowGroupFullyChecked))
+      constraints[i].bitmap.setActualMembership(rowGroupId, constraints[i].hadRows);
+    constraints[i].rowGroupId = -1;
+  }
+}
+
+bool ParquetCursor::nextRowGroup() {
+  recordRowGroupResults();
+
+start:
+  // Ensure that rowId points at the start of this rowGroup (eg, in the case where
+  // we skipped an entire row group).
+  rowId = rowGroupStartRowId + rowGroupSize;
+
+  if((rowGroupId + 1) >= numRowGroups) {
+    return false;
+  }
+
+  // Jump straight to the row group holding the next rowid that the rowid
+  // constraints allow
+  if(seeksRowIds) {
+    int target = nextCandidateRowId(rowId + 1);
+    if(target > numRows)
+      return false;
+
+    int group = table->findRowGroup(target);
+    if(group > rowGroupId + 1) {
+      rowGroupId = group - 1;
+      rowId = table->getRowGroupStart(group);
+    }
+  }
+
+  rowGroupStartRowId = rowId;
+  rowGroupId++;
+  rowGroupMetadata = table->getRowGroupMetadata(rowGroupId);
+  rowGroupSize = rowsLeftInRowGroup = rowGroupMetadata->num_rows();
+  // Other columns' readers were never made
+  for(unsigned int i = 0; i < usedColumns.size(); i++) {
+    colReaders[usedColumns[i]] = NULL;
+    pageReaders[usedColumns[i]] = NULL;
+    stopRecording(usedColumns[i]);
+    stableDictionaries[usedColumns[i]].clear();
+  }
+
+  // The dictionaries they cached results for went with the readers
+  for(unsigned int i = 0; i < dictionaryMatches.size(); i++) {
+    dictionaryMatches[i].clear();
+  }
+
+  selection.clear();
+
+  // Empty batches positioned at the first row of the row group
+  for(unsigned int i = 0; i < usedColumns.size(); i++) {
+    ColumnBatch& batch = batches[usedColumns[i]];
+    batch.startRow = rowId + 1;
+    batch.numRows = 0;
+    batch.dictionaryEncoded = false;
+  }
+
+  // Increment rowId so currentRowGroupSatisfiesFilter can access it;
+  // it'll get decremented by our caller
+  rowId++;
+
+  // We're going to scan this row group; reset the expectation of discovering
+  // a row
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    constraints[i].hadRows = false;
+  }
+  rowGroupFullyChecked = true;
+  rowGroupHadRows = false;
+
+  if(pastMatchingRun(rowGroupId, *rowGroupMetadata, rowId, inMatchingRun)) {
+    // Stand on the last row of the file so the scan ends here
+    rowGroupId = numRowGroups - 1;
+    rowGroupStartRowId = numRows;
+    rowGroupSize = 0;
+    rowsLeftInRowGroup = 0;
+    return false;
+  }
+
+  if(!currentRowGroupSatisfiesFilter())
+    goto start;
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    constraints[i].rowGroupId = rowGroupId;
+  }
+  excludePages();
+
+  // Only now do we need the file, so files whose row groups are all ruled
+  // out are never opened
+  useFile(table->getRowGroupFile(rowGroupId));
+  rowGroup = reader->RowGroup(table->getFileRowGroup(rowGroupId));
+
+  // Pick up the pages read ahead, or the columns decoded, for this row
+  // group, if any. Neither looks past the end of the file, and prefetches
+  // go by the file's numbering.
+  prefetched = NULL;
+  if(prefetch.valid()) {
+    prefetched = prefetch.get();
+    if(prefetched->rowGroupId != table->getFileRowGroup(rowGroupId))
+      prefetched = NULL;
+  }
+
+  decoded = NULL;
+  while(!decoding.empty() && decoding.front().first < rowGroupId) {
+    decoding.front().second.wait();
+    decoding.pop_front();
+  }
+  if(!decoding.empty() && decoding.front().first == rowGroupId) {
+    decoded = decoding.front().second.get();
+    decoding.pop_front();
+
+    for(unsigned int i = 0; i < decoded->decoded.size(); i++) {
+      if(decoded->decoded[i])
+        countColumnChunk(i);
+    }
+  }
+
+  for(unsigned int i = 0; i < usedColumns.size(); i++) {
+    adviseColumnChunk(usedColumns[i]);
+  }
+
+  if(limitEndsInRowGroup())
+    return true;
+
+  if(table->getOptions().threads > 1)
+    scheduleDecodes();
+  else
+    startPrefetch();
+  return true;
+}
+
+// Start reading the next row group we'll scan on a helper thread, so that its
+// I/O and decompression overlap with SQLite consuming this one.
+//
+// Only the columns this scan uses are fetched. If SQLite didn't say which
+// those are, that's the columns read so far, so nothing is prefetched until
+// the first row group has been scanned.
+void ParquetCursor::startPrefetch() {
+  const std::vector<int>& columns = usedColumns;
+  if(columns.empty())
+    return;
+
+  int firstRowId = rowGroupStartRowId + rowGroupSize + 1;
+  std::vector<unsigned char> inRun = inMatchingRun;
+  for(int group = rowGroupId + 1; group < numRowGroups; group++) {
+    // Our reader is only good for this file
+    if(table->getRowGroupFile(group) != readerFile)
+      return;
+
+    std::unique_ptr<parquet::RowGroupMetaData> md = table->getRowGroupMetadata(group);
+    if(pastMatchingRun(group, *md, firstRowId, inRun))
+      return;
+
+    if(rowGroupRejectedBy(group, *md, firstRowId) != -1) {
+      firstRowId += md->num_rows();
+      continue;
+    }
+
+    int64_t bytes = 0;
+    for(unsigned int i = 0; i < columns.size(); i++)
+      bytes += md->ColumnChunk(columns[i])->total_compressed_size();
+
+    if(bytes >= PREFETCH_MIN_BYTES) {
+      try {
+        prefetch = std::async(
+            std::launch::async,
+            prefetchRowGroup,
+            reader.get(),
+            table->getFileRowGroup(group),
+            columns);
+      } catch(std::system_error& e) {
+        // Couldn't start a thread; we'll read it ourselves
       }
+    }
+    return;
+  }
+}
 
-      case parquet::Type::BOOLEAN:
-      {
-        parquet::BoolScanner* s = (parquet::BoolScanner*)scanners[col].get();
-        bool rv = false;
-        hadValue = s->NextValue(&rv, &wasNull);
-        colIntValues[col] = rv ? 1 : 0;
-        break;
+// Wait out any prefetch in flight, and forget what it read.
+void ParquetCursor::cancelPrefetch() {
+  if(prefetch.valid())
+    prefetch.wait();
+  prefetch = std::future<std::shared_ptr<PrefetchedRowGroup>>();
+  prefetched = NULL;
+}
+
+// If the file is memory mapped, tell the kernel that we're about to read
+// a column chunk of the current row group from start to finish, so it can
+// start paging it in and read ahead aggressively.
+void ParquetCursor::adviseColumnChunk(int col) {
+  if(mapping == NULL)
+    return;
+
+  std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroupMetadata->ColumnChunk(col);
+  int64_t start = chunk->data_page_offset();
+  if(chunk->has_dictionary_page() &&
+      chunk->dictionary_page_offset() > 0 &&
+      chunk->dictionary_page_offset() < start)
+    start = chunk->dictionary_page_offset();
+  int64_t end = start + chunk->total_compressed_size();
+
+  if(start < 0 || start >= end || end > mapping->size())
+    return;
+
+  // madvise wants a page-aligned address; the mapping itself starts on one.
+  static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+  start -= start % pageSize;
+
+  // This is only advisory, so ignore failures.
+  void* addr = (void*)(mapping->data() + start);
+  madvise(addr, end - start, MADV_SEQUENTIAL);
+  madvise(addr, end - start, MADV_WILLNEED);
+}
+
+// Run the constraints over a block of rows starting at the current row, and
+// record which rows might satisfy all of them in the selection vector.
+//
+// The block never extends past the row group, nor past the batch currently
+// decoded for any constrained column, so each constraint is a tight loop
+// over contiguous values.
+//
+// Rows that definitely do not satisfy the constraints are rejected here,
+// which avoids pointless transitions between the SQLite VM and the extension,
+// that can add up on a dataset of tens of millions of rows. Comparisons on
+// numeric columns, text comparisons and null tests are evaluated exactly:
+// xBestIndex tells SQLite not to check those again.
+void ParquetCursor::filterBlock() {
+  int firstRow = rowId;
+  int endRow = rowGroupStartRowId + rowGroupSize + 1;
+  if(endRow - firstRow > BATCH_SIZE)
+    endRow = firstRow + BATCH_SIZE;
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    int column = constraints[i].column;
+    if(column == -1 || table->isPartitionColumn(column))
+      continue;
+
+    ensureColumn(column);
+    const ColumnBatch& batch = batches[column];
+    if(batch.startRow + batch.numRows < endRow)
+      endRow = batch.startRow + batch.numRows;
+  }
+
+  // Stop short of the next excluded run
+  if(excludedPos < excludedRows.size() &&
+      excludedRows[excludedPos].first > firstRow &&
+      excludedRows[excludedPos].first < endRow)
+    endRow = excludedRows[excludedPos].first;
+
+  int numRows = endRow - firstRow;
+  selectionStartRow = firstRow;
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    int column = constraints[i].column;
+    if(column == -1)
+      continue;
+
+    // Exclude the rest of a page whose header rules it out
+    ParquetPageReader* pageReader = pageReaders[column];
+    int pageFirstRow = pageReader == NULL ? 0 : rowGroupStartRowId + 1 + pageReader->getPageFirstRow();
+    int pageEndRow = pageReader == NULL ? 0 : rowGroupStartRowId + 1 + pageReader->getPageEndRow();
+    if(pageFirstRow <= firstRow && firstRow < pageEndRow && !pageHeaderAdmits(constraints[i])) {
+      std::pair<int, int> range(firstRow, pageEndRow);
+      excludedRows.insert(
+          std::upper_bound(excludedRows.begin() + excludedPos, excludedRows.end(), range),
+          range);
+      selection.assign(numRows, 0);
+      rowGroupFullyChecked = false;
+      return;
+    }
+  }
+
+  selection.assign(numRows, 1);
+  unsigned char* matches = &constraintMatches[0];
+
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    int column = constraints[i].column;
+    int op = constraints[i].op;
+
+    if(constraints[i].type == Null && op != IsNull && op != IsNotNull && op != Is && op != IsNot) {
+      // A comparison with NULL is never true
+      memset(matches, 0, numRows);
+    } else if(table->isPartitionColumn(column)) {
+      memset(matches, partitionSatisfies(constraints[i], table->getRowGroupFile(rowGroupId)), numRows);
+    } else if(op == IsNull || op == IsNotNull) {
+      if(column == -1) {
+        // rowid is never null
+        memset(matches, op == IsNotNull, numRows);
+      } else {
+        const ColumnBatch& batch = batches[column];
+        const unsigned char* nulls = &batch.nulls[firstRow - batch.startRow];
+        for(int j = 0; j < numRows; j++)
+          matches[j] = (op == IsNull) == (nulls[j] != 0);
       }
-      case parquet::Type::FIXED_LEN_BYTE_ARRAY:
-      {
-        parquet::FixedLenByteArrayScanner* s = (parquet::FixedLenByteArrayScanner*)scanners[col].get();
-        parquet::FixedLenByteArray flba;
-        hadValue = s->NextValue(&flba, &wasNull);
-        colByteArrayValues[col].ptr = flba.ptr;
-        // TODO: cache this
-        colByteArrayValues[col].len = rowGroupMetadata->schema()->Column(col)->type_length();
-        break;
+    } else if(column == -1) {
+      filterIntegerBlock(constraints[i], firstRow, numRows, matches);
+    } else if(logicalTypes[column] == parquet::LogicalType::UTF8) {
+      filterTextBlock(constraints[i], dictionaryMatches[i], firstRow, numRows, matches);
+    } else {
+      parquet::Type::type pqType = types[column];
+      if(pqType == parquet::Type::INT32 ||
+         pqType == parquet::Type::INT64 ||
+         pqType == parquet::Type::INT96 ||
+         pqType == parquet::Type::BOOLEAN) {
+        filterIntegerBlock(constraints[i], firstRow, numRows, matches);
+      } else if(pqType == parquet::Type::FLOAT || pqType == parquet::Type::DOUBLE) {
+        filterDoubleBlock(constraints[i], firstRow, numRows, matches);
+      } else {
+        memset(matches, 1, numRows);
       }
-      default:
-        // Should be impossible to get here as we should have forbidden this at
-        // CREATE time -- maybe file changed underneath us?
-        std::ostringstream ss;
-        ss << __FILE__ << ":" << __LINE__ << ": column " << col << " has unsupported type: " <<
-          parquet::TypeToString(types[col]);
-        throw std::invalid_argument(ss.str());
+    }
+
+    // hadRows defaults to false; so only set it if some row matched
+    // ideally we'd short-circuit if we'd already set this group as visited
+    bool hadRows = false;
+    for(int j = 0; j < numRows; j++) {
+      hadRows |= matches[j] != 0;
+      selection[j] &= matches[j];
+    }
+
+    if(hadRows)
+      constraints[i].hadRows = true;
+  }
+
+  if(numRows > 0 && memchr(&selection[0], 1, numRows) != NULL)
+    rowGroupHadRows = true;
+}
+
+void ParquetCursor::next() {
+  if(rowsLeftInLimit == 0) {
+    // put rowId over the edge so eof returns true
+    rowId = numRows + 1;
+    return;
+  }
+
+  if(rowsToSkip > 0)
+    skipOffset();
+
+  nextRow();
+  if(rowsLeftInLimit > 0)
+    rowsLeftInLimit--;
+}
+
+// Pass over the first rowsToSkip rows that satisfy the constraints. Without
+// constraints, whole row groups are passed over using their row counts from
+// the metadata, and the rest of the gap is left to ensureColumn to skip.
+void ParquetCursor::skipOffset() {
+  if(constraints.size() > 0) {
+    for(; rowsToSkip > 0 && !eof(); rowsToSkip--)
+      nextRow();
+    return;
+  }
+
+  // Stand on the last row of each row group we skip, as though we'd
+  // scanned it, so nextRowGroup picks up after it.
+  while(rowGroupId + 1 < numRowGroups) {
+    int64_t groupRows = table->getRowGroupStart(rowGroupId + 2) - table->getRowGroupStart(rowGroupId + 1);
+    if(groupRows + rowsLeftInRowGroup > rowsToSkip)
+      break;
+
+    rowsToSkip -= rowsLeftInRowGroup + groupRows;
+    rowGroupId++;
+    rowGroupStartRowId += rowGroupSize;
+    rowGroupSize = groupRows;
+    rowsLeftInRowGroup = 0;
+  }
+
+  if(rowsToSkip == 0)
+    return;
+
+  if(rowsLeftInRowGroup == 0) {
+    nextRow();
+    rowsToSkip--;
+  }
+
+  if(rowsToSkip > rowsLeftInRowGroup)
+    rowsToSkip = rowsLeftInRowGroup;
+  rowId += rowsToSkip;
+  rowsLeftInRowGroup -= rowsToSkip;
+  rowsToSkip = 0;
+}
+
+// Whether the offset and limit will be used up by the rest of the current
+// row group, in which case there's no point reading ahead. With constraints we can't
+// know how many rows will satisfy them, so assume it won't be.
+bool ParquetCursor::limitEndsInRowGroup() const {
+  return rowsLeftInLimit >= 0 &&
+    constraints.size() == 0 &&
+    rowsToSkip + rowsLeftInLimit <= rowsLeftInRowGroup;
+}
+
+void ParquetCursor::nextRow() {
+start:
+  if(rowsLeftInRowGroup == 0) {
+    if(!nextRowGroup()) {
+      // put rowId over the edge so eof returns true
+      rowId = numRows + 1;
+      return;
+    } else {
+      // After a successful nextRowGroup, rowId is pointing at the current row. Make it
+      // point before so the rest of the logic works out.
+      rowId--;
+    }
+  }
+
+  rowsLeftInRowGroup--;
+  rowId++;
+  if(constraints.size() == 0)
+    return;
+
+  int selectionEndRow = selectionStartRow + selection.size();
+  if(rowId >= selectionEndRow) {
+    if(seeksRowIds || excludedPos < excludedRows.size()) {
+      // Pass over the rows the rowid constraints or the page statistics rule
+      // out without filtering them; ensureColumn skips them by page.
+      int target = nextCandidateRow(rowId);
+      if(target != rowId)
+        rowGroupFullyChecked = false;
+      if(target - rowId > rowsLeftInRowGroup) {
+        rowId += rowsLeftInRowGroup;
+        rowsLeftInRowGroup = 0;
+        goto start;
+      }
+      rowsLeftInRowGroup -= target - rowId;
+      rowId = target;
+    }
+
+    filterBlock();
+    selectionEndRow = selectionStartRow + selection.size();
+  }
+
+  // Jump straight to the next selected row in this block, or past the
+  // block entirely if there isn't one.
+  const unsigned char* current = &selection[rowId - selectionStartRow];
+  const unsigned char* selected = (const unsigned char*)memchr(current, 1, selectionEndRow - rowId);
+  int skipped = selected == NULL ? selectionEndRow - 1 - rowId : selected - current;
+  rowId += skipped;
+  rowsLeftInRowGroup -= skipped;
+
+  if(selected == NULL)
+    goto start;
+}
+
+int ParquetCursor::getRowId() {
+  return rowId;
+}
+
+bool ParquetCursor::eof() {
+  return rowId > numRows;
+}
+
+// Spread valuesRead packed values across levels row-aligned slots, marking
+// the rows whose definition level says they're null.
+//
+// We fill from the back, so this is safe to run in place when in and out
+// are the same buffer.
+template<typename In, typename Out, typename Convert>
+static void spreadValues(
+    const In* in,
+    Out* out,
+    unsigned char* nulls,
+    const int16_t* defLevels,
+    int16_t maxDefLevel,
+    int64_t levels,
+    int64_t valuesRead,
+    Convert convert) {
+  if(valuesRead == levels) {
+    for(int64_t i = 0; i < levels; i++) {
+      out[i] = convert(in[i]);
+      nulls[i] = 0;
+    }
+    return;
+  }
+
+  int64_t v = valuesRead;
+  for(int64_t i = levels - 1; i >= 0; i--) {
+    if(defLevels[i] == maxDefLevel) {
+      out[i] = convert(in[--v]);
+      nulls[i] = 0;
+    } else {
+      out[i] = Out();
+      nulls[i] = 1;
+    }
+  }
+}
+
+template<typename T>
+static T identity(const T& v) { return v; }
+
+// SQLite has no NaN: sqlite3_result_double turns it into NULL, so treat it
+// as null here too, for the filters to agree with SQLite.
+static void nullNaNs(const double* values, unsigned char* nulls, int64_t levels) {
+  for(int64_t i = 0; i < levels; i++) {
+    if(values[i] != values[i])
+      nulls[i] = 1;
+  }
+}
+
+// Decode the next run of values from a column reader into batch's values,
+// returning how many rows were decoded. ReadBatch never crosses a page
+// boundary, so a batch may hold fewer than BATCH_SIZE rows.
+//
+// defLevels and scratch must have room for BATCH_SIZE levels and INT96s.
+static int64_t decodeBatch(
+    parquet::ColumnReader* colReader,
+    ColumnBatch& batch,
+    int16_t* defLevels,
+    unsigned char* scratch) {
+  int16_t maxDefLevel = colReader->descr()->max_definition_level();
+  batch.nulls.resize(BATCH_SIZE);
+
+  int64_t levels = 0;
+  int64_t valuesRead = 0;
+  int16_t* levelsPtr = defLevels;
+  unsigned char* nulls = &batch.nulls[0];
+
+  switch(colReader->descr()->physical_type()) {
+    case parquet::Type::INT32:
+    {
+      int32_t* values = (int32_t*)scratch;
+      levels = ((parquet::Int32Reader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      batch.intValues.resize(BATCH_SIZE);
+      spreadValues(values, &batch.intValues[0], nulls, levelsPtr, maxDefLevel, levels, valuesRead,
+          [](int32_t v) { return (int64_t)v; });
+      break;
+    }
+    case parquet::Type::FLOAT:
+    {
+      float* values = (float*)scratch;
+      levels = ((parquet::FloatReader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      batch.doubleValues.resize(BATCH_SIZE);
+      spreadValues(values, &batch.doubleValues[0], nulls, levelsPtr, maxDefLevel, levels, valuesRead,
+          [](float v) { return (double)v; });
+      nullNaNs(&batch.doubleValues[0], nulls, levels);
       break;
     }
+    case parquet::Type::DOUBLE:
+    {
+      batch.doubleValues.resize(BATCH_SIZE);
+      double* values = &batch.doubleValues[0];
+      levels = ((parquet::DoubleReader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      spreadValues(values, values, nulls, levelsPtr, maxDefLevel, levels, valuesRead, identity<double>);
+      nullNaNs(values, nulls, levels);
+      break;
+    }
+    case parquet::Type::BYTE_ARRAY:
+    {
+      batch.byteArrayValues.resize(BATCH_SIZE);
+      parquet::ByteArray* values = &batch.byteArrayValues[0];
+      levels = ((parquet::ByteArrayReader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      spreadValues(values, values, nulls, levelsPtr, maxDefLevel, levels, valuesRead, identity<parquet::ByteArray>);
+      break;
+    }
+    case parquet::Type::INT96:
+    {
+      // INT96 tracks a date with nanosecond precision, convert to ms since epoch.
+      // ...see https://github.com/apache/parquet-format/pull/49 for more
+      //
+      // First 8 bytes: nanoseconds into the day
+      // Last 4 bytes: Julian day
+      // To get nanoseconds since the epoch:
+      // (julian_day - 2440588) * (86400 * 1000 * 1000 * 1000) + nanoseconds
+      parquet::Int96* values = (parquet::Int96*)scratch;
+      levels = ((parquet::Int96Reader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      batch.intValues.resize(BATCH_SIZE);
+      spreadValues(values, &batch.intValues[0], nulls, levelsPtr, maxDefLevel, levels, valuesRead, int96toMsSinceEpoch);
+      break;
+    }
+    case parquet::Type::INT64:
+    {
+      batch.intValues.resize(BATCH_SIZE);
+      int64_t* values = &batch.intValues[0];
+      levels = ((parquet::Int64Reader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      spreadValues(values, values, nulls, levelsPtr, maxDefLevel, levels, valuesRead, identity<int64_t>);
+      break;
+    }
+    case parquet::Type::BOOLEAN:
+    {
+      bool* values = (bool*)scratch;
+      levels = ((parquet::BoolReader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      batch.intValues.resize(BATCH_SIZE);
+      spreadValues(values, &batch.intValues[0], nulls, levelsPtr, maxDefLevel, levels, valuesRead,
+          [](bool v) { return (int64_t)(v ? 1 : 0); });
+      break;
+    }
+    case parquet::Type::FIXED_LEN_BYTE_ARRAY:
+    {
+      parquet::FixedLenByteArray* values = (parquet::FixedLenByteArray*)scratch;
+      levels = ((parquet::FixedLenByteArrayReader*)colReader)->ReadBatch(BATCH_SIZE, levelsPtr, NULL, values, &valuesRead);
+      batch.byteArrayValues.resize(BATCH_SIZE);
+      uint32_t len = colReader->descr()->type_length();
+      spreadValues(values, &batch.byteArrayValues[0], nulls, levelsPtr, maxDefLevel, levels, valuesRead,
+          [len](const parquet::FixedLenByteArray& v) { return parquet::ByteArray(len, v.ptr); });
+      break;
+    }
+    default:
+      // Should be impossible to get here as we should have forbidden this at
+      // CREATE time -- maybe file changed underneath us?
+      std::ostringstream ss;
+      ss << __FILE__ << ":" << __LINE__ << ": column " << colReader->descr()->name() << " has unsupported type: " <<
+        parquet::TypeToString(colReader->descr()->physical_type());
+      throw std::invalid_argument(ss.str());
+    break;
+  }
+
+  if(levels == 0)
+    throw std::invalid_argument("unexpectedly lacking a next value");
+
+  return levels;
+}
+
+// Decode the next run of values for a column into its batch, or take the
+// next batch a worker decoded for it.
+// Plain-encoded byte arrays point into their page, which doesn't outlive
+// the column reader moving on to the next page. Copy them into the batch.
+static void copyByteArrays(ColumnBatch& batch) {
+  size_t size = 0;
+  for(int i = 0; i < batch.numRows; i++) {
+    if(!batch.nulls[i])
+      size += batch.byteArrayValues[i].len;
+  }
+
+  batch.bytes.resize(size);
+  size_t offset = 0;
+  for(int i = 0; i < batch.numRows; i++) {
+    parquet::ByteArray& ba = batch.byteArrayValues[i];
+    if(batch.nulls[i] || ba.len == 0)
+      continue;
+
+    memcpy(&batch.bytes[offset], ba.ptr, ba.len);
+    ba.ptr = &batch.bytes[offset];
+    offset += ba.len;
+  }
+}
+
+template<typename T>
+static void copyPrefix(const std::vector<T>& from, std::vector<T>& to, int n) {
+  if((int)from.size() >= n)
+    to.assign(from.begin(), from.begin() + n);
+}
+
+// Copy a dictionary-encoded batch's byte arrays into the chunk's dictionary,
+// each entry once, so that equal values still share a pointer. Returns the
+// bytes added.
+static size_t copyDictionaryValues(ColumnBatch& batch, RecordedChunk& recorded) {
+  size_t added = 0;
+  for(int i = 0; i < batch.numRows; i++) {
+    if(batch.nulls[i])
+      continue;
+
+    parquet::ByteArray& ba = batch.byteArrayValues[i];
+    const uint8_t*& copy = recorded.dictionary[ba.ptr];
+    if(copy == NULL) {
+      recorded.chunk->dictionary.push_back(std::string((const char*)ba.ptr, ba.len));
+      copy = (const uint8_t*)recorded.chunk->dictionary.back().data();
+      added += sizeof(std::string) + ba.len;
+    }
+    ba.ptr = copy;
+  }
+  return added;
+}
+
+// Copy a batch's values, but not the bytes its byte arrays point into, and
+// renumber its rows from startRow.
+static ColumnBatch copyBatch(const ColumnBatch& batch, int startRow) {
+  ColumnBatch rv;
+  rv.startRow = startRow;
+  rv.numRows = batch.numRows;
+  rv.dictionaryEncoded = batch.dictionaryEncoded;
+  copyPrefix(batch.nulls, rv.nulls, batch.numRows);
+  copyPrefix(batch.intValues, rv.intValues, batch.numRows);
+  copyPrefix(batch.doubleValues, rv.doubleValues, batch.numRows);
+  copyPrefix(batch.byteArrayValues, rv.byteArrayValues, batch.numRows);
+  return rv;
+}
 
-    if(!hadValue)
+static size_t batchBytes(const ColumnBatch& batch) {
+  return sizeof(ColumnBatch) +
+    batch.nulls.size() +
+    batch.intValues.size() * sizeof(int64_t) +
+    batch.doubleValues.size() * sizeof(double) +
+    batch.byteArrayValues.size() * sizeof(parquet::ByteArray) +
+    batch.bytes.size();
+}
+
+void ParquetCursor::readBatch(int col) {
+  ColumnBatch& batch = batches[col];
+
+  if(isDecoded(col)) {
+    std::deque<ColumnBatch>& pending = decoded->batches[col];
+    if(pending.empty())
       throw std::invalid_argument("unexpectedly lacking a next value");
 
-    colNulls[col] = wasNull;
+    batch = std::move(pending.front());
+    pending.pop_front();
+    return;
+  }
+
+  batch.startRow += batch.numRows;
+  batch.numRows = 0;
+  batch.numRows = decodeBatch(colReaders[col].get(), batch, &defLevels[0], &scratch[0]);
+  batch.dictionaryEncoded = pageReaders[col]->isPageDictionaryEncoded();
+
+  if(!recording[col])
+    return;
+
+  int firstRow = rowGroupStartRowId + 1;
+  CachedColumnChunk& chunk = *recorded[col].chunk;
+  chunk.batches.push_back(copyBatch(batch, batch.startRow - firstRow));
+  ColumnBatch& copy = chunk.batches.back();
+  if(!copy.byteArrayValues.empty()) {
+    if(copy.dictionaryEncoded)
+      chunk.bytes += copyDictionaryValues(copy, recorded[col]);
+    else
+      copyByteArrays(copy);
+  }
+  chunk.bytes += batchBytes(copy);
+
+  // The cache wouldn't keep it
+  if(chunk.bytes > recordingLimit) {
+    stopRecording(col);
+    return;
+  }
+
+  if(batch.startRow + batch.numRows >= firstRow + rowGroupSize) {
+    const TableFile& file = table->getTableFile(readerFile);
+    ColumnChunkCache::instance().put(file.path, file.identity, table->getFileRowGroup(rowGroupId), col, recorded[col].chunk);
+    stopRecording(col);
+  }
+}
+
+// Start copying the column chunk of the current row group for the
+// ColumnChunkCache, unless the cache is off or the copy would be wasted:
+// the chunk is bigger encoded than the cache, or the page index will have
+// us pass over some of it.
+void ParquetCursor::startRecording(int col) {
+  recordingLimit = ColumnChunkCache::instance().getMaxBytes();
+  if(recordingLimit == 0 || !excludedRows.empty() ||
+      (size_t)rowGroupMetadata->ColumnChunk(col)->total_uncompressed_size() > recordingLimit)
+    return;
+
+  recording[col] = 1;
+  recorded[col].chunk.reset(new CachedColumnChunk());
+  recorded[col].chunk->bytes = 0;
+}
+
+void ParquetCursor::stopRecording(int col) {
+  recording[col] = 0;
+  recorded[col].chunk = NULL;
+  recorded[col].dictionary.clear();
+}
+
+// Take a column chunk of the current row group from the ColumnChunkCache,
+// if it's there, as though a worker had decoded it.
+bool ParquetCursor::useCachedChunk(int col) {
+  ColumnChunkCache& cache = ColumnChunkCache::instance();
+  if(!cache.isEnabled())
+    return false;
+
+  const TableFile& file = table->getTableFile(readerFile);
+  std::shared_ptr<const CachedColumnChunk> chunk =
+    cache.get(file.path, file.identity, table->getFileRowGroup(rowGroupId), col);
+  if(chunk == NULL)
+    return false;
+
+  if(decoded == NULL) {
+    decoded.reset(new DecodedRowGroup());
+    decoded->rowGroupId = rowGroupId;
+  }
+  if(decoded->decoded.size() <= (unsigned int)col) {
+    decoded->colReaders.resize(col + 1);
+    decoded->batches.resize(col + 1);
+    decoded->decoded.resize(col + 1);
+  }
+
+  int firstRow = rowGroupStartRowId + 1;
+  std::deque<ColumnBatch>& pending = decoded->batches[col];
+  pending.clear();
+  for(unsigned int i = 0; i < chunk->batches.size(); i++)
+    pending.push_back(copyBatch(chunk->batches[i], firstRow + chunk->batches[i].startRow));
+  decoded->decoded[col] = 1;
+  decoded->cached.push_back(chunk);
+  return true;
+}
+
+// Decode the given columns of a row group in full. Run on a worker thread by
+// scheduleDecodes; fileRowGroupId is the row group's number within the
+// reader's file, and firstRowId is the rowid of its first row.
+static std::shared_ptr<DecodedRowGroup> decodeRowGroup(
+    parquet::ParquetFileReader* reader,
+    int rowGroupId,
+    int fileRowGroupId,
+    int firstRowId,
+    std::vector<int> columns) {
+  std::shared_ptr<DecodedRowGroup> rv(new DecodedRowGroup());
+  rv->rowGroupId = rowGroupId;
+  rv->rowGroup = reader->RowGroup(fileRowGroupId);
+
+  const parquet::RowGroupMetaData* metadata = rv->rowGroup->metadata();
+  int64_t numRows = metadata->num_rows();
+  int numColumns = metadata->num_columns();
+  rv->colReaders.resize(numColumns);
+  rv->batches.resize(numColumns);
+  rv->decoded.resize(numColumns);
+
+  std::vector<int16_t> defLevels(BATCH_SIZE);
+  std::vector<unsigned char> scratch(BATCH_SIZE * sizeof(parquet::Int96));
+
+  for(unsigned int i = 0; i < columns.size(); i++) {
+    int col = columns[i];
+    if(col < 0 || col >= numColumns)
+      continue;
+
+    ParquetPageReader* pageReader = new ParquetPageReader(rv->rowGroup->GetColumnPageReader(col));
+    std::unique_ptr<parquet::PageReader> ownedPageReader(pageReader);
+    rv->colReaders[col] = parquet::ColumnReader::Make(
+        metadata->schema()->Column(col),
+        std::move(ownedPageReader));
+    parquet::Type::type type = metadata->schema()->Column(col)->physical_type();
+
+    int64_t row = 0;
+    while(row < numRows) {
+      rv->batches[col].push_back(ColumnBatch());
+      ColumnBatch& batch = rv->batches[col].back();
+      batch.startRow = firstRowId + row;
+      batch.numRows = decodeBatch(rv->colReaders[col].get(), batch, &defLevels[0], &scratch[0]);
+      // Dictionary-encoded values point into the column reader's
+      // dictionary, which we keep.
+      batch.dictionaryEncoded = pageReader->isPageDictionaryEncoded();
+      if(!batch.dictionaryEncoded &&
+          (type == parquet::Type::BYTE_ARRAY || type == parquet::Type::FIXED_LEN_BYTE_ARRAY))
+        copyByteArrays(batch);
+      row += batch.numRows;
+    }
+
+    rv->decoded[col] = 1;
+  }
+
+  return rv;
+}
+
+bool ParquetCursor::isDecoded(int col) const {
+  return decoded != NULL && (unsigned int)col < decoded->decoded.size() && decoded->decoded[col];
+}
+
+// Keep up to the configured number of threads busy decoding the row groups
+// that follow the current one. Only the columns this scan uses are decoded,
+// as for startPrefetch; columns first asked for later are read on this
+// thread.
+void ParquetCursor::scheduleDecodes() {
+  const std::vector<int>& columns = usedColumns;
+  if(columns.empty())
+    return;
+
+  if(nextRowGroupToDecode <= rowGroupId) {
+    nextRowGroupToDecode = rowGroupId + 1;
+    nextRowGroupToDecodeFirstRowId = rowGroupStartRowId + rowGroupSize + 1;
+    inDecodeRun = inMatchingRun;
+  }
+
+  size_t threads = table->getOptions().threads;
+  while(decoding.size() < threads && nextRowGroupToDecode < numRowGroups) {
+    // Rows from the current one up to the next row group cover the limit
+    if(rowsLeftInLimit >= 0 &&
+        constraints.size() == 0 &&
+        nextRowGroupToDecodeFirstRowId - rowId >= rowsToSkip + rowsLeftInLimit)
+      break;
+
+    int group = nextRowGroupToDecode;
+    int firstRowId = nextRowGroupToDecodeFirstRowId;
+    // Our reader is only good for this file
+    if(table->getRowGroupFile(group) != readerFile)
+      break;
+
+    std::unique_ptr<parquet::RowGroupMetaData> md = table->getRowGroupMetadata(group);
+    if(pastMatchingRun(group, *md, firstRowId, inDecodeRun)) {
+      nextRowGroupToDecode = numRowGroups;
+      break;
+    }
+
+    nextRowGroupToDecode++;
+    nextRowGroupToDecodeFirstRowId += md->num_rows();
+
+    if(rowGroupRejectedBy(group, *md, firstRowId) != -1)
+      continue;
+
+    try {
+      decoding.push_back(std::make_pair(
+            group,
+            std::async(
+              std::launch::async,
+              decodeRowGroup,
+              reader.get(),
+              group,
+              table->getFileRowGroup(group),
+              firstRowId,
+              columns)));
+    } catch(std::system_error& e) {
+      // Couldn't start a thread; we'll read it ourselves
+      return;
+    }
+  }
+}
+
+// Wait out any workers, and forget what they decoded.
+void ParquetCursor::cancelDecodes() {
+  for(unsigned int i = 0; i < decoding.size(); i++) {
+    decoding[i].second.wait();
+  }
+  decoding.clear();
+  decoded = NULL;
+  nextRowGroupToDecode = 0;
+  nextRowGroupToDecodeFirstRowId = 0;
+}
+
+// ColumnReader::Skip is only available on the typed readers.
+void ParquetCursor::skipRows(int col, int64_t numRows) {
+  // The chunk won't be read in full
+  stopRecording(col);
+
+  parquet::ColumnReader* colReader = colReaders[col].get();
+  int64_t skipped = 0;
+
+  switch(types[col]) {
+    case parquet::Type::INT32:
+      skipped = ((parquet::Int32Reader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::FLOAT:
+      skipped = ((parquet::FloatReader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::DOUBLE:
+      skipped = ((parquet::DoubleReader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::BYTE_ARRAY:
+      skipped = ((parquet::ByteArrayReader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::INT96:
+      skipped = ((parquet::Int96Reader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::INT64:
+      skipped = ((parquet::Int64Reader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::BOOLEAN:
+      skipped = ((parquet::BoolReader*)colReader)->Skip(numRows);
+      break;
+    case parquet::Type::FIXED_LEN_BYTE_ARRAY:
+      skipped = ((parquet::FixedLenByteArrayReader*)colReader)->Skip(numRows);
+      break;
+    default:
+      // Should be impossible to get here as we should have forbidden this at
+      // CREATE time -- maybe file changed underneath us?
+      std::ostringstream ss;
+      ss << __FILE__ << ":" << __LINE__ << ": column " << col << " has unsupported type: " <<
+        parquet::TypeToString(types[col]);
+      throw std::invalid_argument(ss.str());
+    break;
+  }
+
+  if(skipped != numRows)
+    throw std::invalid_argument("unexpectedly lacking a next value");
+}
+
+// Position a column's reader so that its next batch starts at row.
+//
+// If row is past the end of the page being read, the rest of that page and
+// any whole pages in between are dropped without being decoded.
+void ParquetCursor::skipToRow(int col, int row) {
+  ColumnBatch& batch = batches[col];
+  ParquetPageReader* pageReader = pageReaders[col];
+
+  // Positions relative to the start of the row group, as the page reader
+  // tracks them
+  int64_t target = row - (rowGroupStartRowId + 1);
+  int64_t position = batch.startRow + batch.numRows - (rowGroupStartRowId + 1);
+  int64_t pageEnd = pageReader->getPageEndRow();
+
+  if(target > pageEnd) {
+    // ColumnReader::Skip only discards the rest of a page without decoding
+    // it when asked to skip more rows than the page has left, so we ask for
+    // one extra row -- and make sure the page it lands on holds row
+    // target - 1, so that we don't overshoot.
+    pageReader->skipPagesBefore(target - 1);
+    skipRows(col, pageEnd - position + 1);
+    position = pageReader->getPageFirstRow() + 1;
+  }
+
+  if(target > position)
+    skipRows(col, target - position);
+
+  batch.startRow = row;
+  batch.numRows = 0;
+}
+
+void ParquetCursor::ensureColumn(int col) {
+  // -1 signals rowid, which is trivially available, as are partition values
+  if(col == -1 || table->isPartitionColumn(col))
+    return;
+
+  // Another scan may have decoded it already
+  if(colReaders[col].get() == NULL && !isDecoded(col) && useCachedChunk(col) && !columnsUsed[col])
+    useColumn(col);
+
+  // A worker has already decoded it; just find the right batch
+  if(isDecoded(col)) {
+    ColumnBatch& batch = batches[col];
+    while(batch.startRow + batch.numRows <= rowId) {
+      readBatch(col);
+    }
+    return;
+  }
+
+  // need to ensure a reader exists
+  if(colReaders[col].get() == NULL) {
+    // Columns we expected to read were advised by nextRowGroup
+    if(!columnsUsed[col]) {
+      useColumn(col);
+      adviseColumnChunk(col);
+    }
+    countColumnChunk(col);
+
+    std::unique_ptr<parquet::PageReader> source;
+    if(prefetched != NULL && (unsigned int)col < prefetched->fetched.size() && prefetched->fetched[col]) {
+      source.reset(new PrefetchedPageReader(std::move(prefetched->pages[col])));
+      prefetched->fetched[col] = 0;
+    } else {
+      source = rowGroup->GetColumnPageReader(col);
+    }
+
+    std::unique_ptr<ParquetPageReader> pageReader(new ParquetPageReader(std::move(source)));
+    pageReaders[col] = pageReader.get();
+    stopRecording(col);
+    startRecording(col);
+    colReaders[col] = parquet::ColumnReader::Make(
+        rowGroupMetadata->schema()->Column(col),
+        std::move(pageReader));
+  }
+
+  ColumnBatch& batch = batches[col];
+  int nextRow = batch.startRow + batch.numRows;
+  if(nextRow > rowId)
+    return;
+
+  // We may need to pass over some rows, eg, a query like
+  // SELECT a WHERE b = 10
+  // may have read b, but skipped a until b matches the predicate.
+  //
+  // If the gap runs past the current page, or is at least a batch long,
+  // skip it rather than decoding it.
+  int pageEnd = rowGroupStartRowId + 1 + pageReaders[col]->getPageEndRow();
+  if(rowId > nextRow && (rowId >= pageEnd || rowId - nextRow >= BATCH_SIZE))
+    skipToRow(col, rowId);
+
+  while(batch.startRow + batch.numRows <= rowId) {
+    readBatch(col);
   }
 }
 
@@ -905,23 +2286,43 @@ bool ParquetCursor::isNull(int col) {
   if(col == -1)
     return false;
 
-  return colNulls[col];
+  if(table->isPartitionColumn(col))
+    return table->getPartitionValue(table->getRowGroupFile(rowGroupId), col) == NULL;
+
+  const ColumnBatch& batch = batches[col];
+  return batch.nulls[rowId - batch.startRow];
 }
 
 int ParquetCursor::getInt32(int col) {
-  return colIntValues[col];
+  const ColumnBatch& batch = batches[col];
+  return batch.intValues[rowId - batch.startRow];
 }
 
 long ParquetCursor::getInt64(int col) {
-  return colIntValues[col];
+  const ColumnBatch& batch = batches[col];
+  return batch.intValues[rowId - batch.startRow];
 }
 
 double ParquetCursor::getDouble(int col) {
-  return colDoubleValues[col];
+  const ColumnBatch& batch = batches[col];
+  return batch.doubleValues[rowId - batch.startRow];
 }
 
 parquet::ByteArray* ParquetCursor::getByteArray(int col) {
-  return &colByteArrayValues[col];
+  if(table->isPartitionColumn(col)) {
+    const std::string* value = table->getPartitionValue(table->getRowGroupFile(rowGroupId), col);
+    partitionValue = parquet::ByteArray(value->size(), (const uint8_t*)value->data());
+    return &partitionValue;
+  }
+
+  ColumnBatch& batch = batches[col];
+  return &batch.byteArrayValues[rowId - batch.startRow];
+}
+
+const char* ParquetCursor::getStableValue(int col, const parquet::ByteArray& ba) {
+  if(table->isPartitionColumn(col) || !batches[col].dictionaryEncoded)
+    return NULL;
+  return stableDictionaries[col].acquire(ba);
 }
 
 parquet::Type::type ParquetCursor::getPhysicalType(int col) {
@@ -933,22 +2334,100 @@ parquet::LogicalType::type ParquetCursor::getLogicalType(int col) {
 }
 
 void ParquetCursor::close() {
+  // The helper threads are using our reader
+  cancelPrefetch();
+  cancelDecodes();
+  releaseReader();
+}
+
+// Give our reader back to the pool. Nothing may be using it.
+void ParquetCursor::releaseReader() {
+  // The row group and column readers refer to the file reader, so let go
+  // of them before someone else borrows it.
+  for(unsigned int i = 0; i < colReaders.size(); i++) {
+    colReaders[i] = NULL;
+    pageReaders[i] = NULL;
+    stopRecording(i);
+    stableDictionaries[i].clear();
+  }
+  rowGroup = NULL;
+  prefetched = NULL;
+
   if(reader != NULL) {
-    reader->Close();
+    const TableFile& file = table->getTableFile(readerFile);
+    ParquetReaderPool::PooledReader pooled;
+    pooled.reader = std::move(reader);
+    pooled.mapping = mapping;
+    mapping = NULL;
+    ParquetReaderPool::instance().release(
+        file.path,
+        file.identity,
+        table->getOptions().mmap,
+        std::move(pooled));
   }
+  readerFile = -1;
 }
 
-void ParquetCursor::reset(std::vector<Constraint> constraints) {
-  close();
+// Make sure we have a reader for the given file of the table. Read-ahead
+// never crosses into another file, so whatever is in flight when we move
+// on is for row groups we've passed.
+void ParquetCursor::useFile(int file) {
+  if(reader != NULL && readerFile == file)
+    return;
+
+  cancelPrefetch();
+  cancelDecodes();
+  releaseReader();
+
+  const TableFile& tableFile = table->getTableFile(file);
+  ParquetReaderPool::PooledReader pooled = ParquetReaderPool::instance().acquire(
+      tableFile.path,
+      tableFile.identity,
+      table->getOptions().mmap,
+      tableFile.metadata);
+  reader = std::move(pooled.reader);
+  mapping = pooled.mapping;
+  readerFile = file;
+}
+
+void ParquetCursor::reset(
+    std::vector<Constraint> constraints,
+    RowGroupBitmap conjunction,
+    int64_t limit,
+    int64_t offset,
+    std::vector<unsigned char> columnsUsed) {
+  cancelPrefetch();
+  cancelDecodes();
   this->constraints = constraints;
+  this->conjunction = conjunction;
+  oneRun.resize(constraints.size());
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    oneRun[i] = matchesOneRun(constraints[i]);
+  }
+  inMatchingRun.assign(constraints.size(), 0);
+  seeksRowIds = false;
+  for(unsigned int i = 0; i < constraints.size(); i++) {
+    int op = constraints[i].op;
+    seeksRowIds = seeksRowIds || (constraints[i].column == -1 &&
+        constraints[i].type == Integer &&
+        (op == Equal || op == Is || op == GreaterThan || op == GreaterThanOrEqual ||
+         op == LessThan || op == LessThanOrEqual || op == In));
+  }
+  rowsLeftInLimit = limit < 0 ? -1 : limit;
+  rowsToSkip = offset < 0 ? 0 : offset;
+  dictionaryMatches.resize(constraints.size());
+  for(unsigned int i = 0; i < dictionaryMatches.size(); i++) {
+    dictionaryMatches[i].clear();
+  }
   rowId = 0;
-  // TODO: consider having a long lived handle in ParquetTable that can be borrowed
-  // without incurring the cost of opening the file from scratch twice
-  reader = parquet::ParquetFileReader::OpenFile(
-      table->getFile().data(),
-      true,
-      parquet::default_reader_properties(),
-      table->getMetadata());
+  selectionStartRow = 0;
+  selection.clear();
+  excludedRows.clear();
+  excludedPos = 0;
+  rowGroupFullyChecked = true;
+  rowGroupHadRows = false;
+  // Hang on to our reader between scans; xFilter runs once per outer row
+  // of a nested-loop join. nextRowGroup borrows one when it first needs it.
 
   rowGroupId = -1;
   rowGroupSize = 0;
@@ -957,14 +2436,177 @@ void ParquetCursor::reset(std::vector<Constraint> constraints) {
   // TODO: or at least, fail fast if detected
   rowsLeftInRowGroup = 0;
 
-  numRows = reader->metadata()->num_rows();
-  numRowGroups = reader->metadata()->num_row_groups();
+  numRows = table->getNumRows();
+  numRowGroups = table->getNumRowGroups();
+
+  // Per-column state is only touched for the columns a scan uses, but is
+  // indexed by column
+  const parquet::SchemaDescriptor* schema = table->getSchema();
+  unsigned int numColumns = schema->num_columns();
+  if(table->getNumColumns() > numColumns)
+    numColumns = table->getNumColumns();
+  while(numColumns >= colReaders.size()) {
+    colReaders.push_back(std::shared_ptr<parquet::ColumnReader>());
+    pageReaders.push_back(NULL);
+    batches.push_back(ColumnBatch());
+    recording.push_back(0);
+    recorded.push_back(RecordedChunk());
+    stableDictionaries.push_back(StableDictionary());
+  }
+
+  // Partition columns are text
+  if(types.size() != numColumns) {
+    types.assign(numColumns, parquet::Type::BYTE_ARRAY);
+    logicalTypes.assign(numColumns, parquet::LogicalType::UTF8);
+    for(int i = 0; i < schema->num_columns(); i++) {
+      types[i] = schema->Column(i)->physical_type();
+      logicalTypes[i] = schema->Column(i)->logical_type();
+    }
+  }
+
+  // The last scan's readers are for a row group we've left
+  for(unsigned int i = 0; i < usedColumns.size(); i++) {
+    colReaders[usedColumns[i]] = NULL;
+    pageReaders[usedColumns[i]] = NULL;
+    stopRecording(usedColumns[i]);
+    stableDictionaries[usedColumns[i]].clear();
+  }
+  this->columnsUsed.assign(colReaders.size(), 0);
+  usedColumns.clear();
+  for(unsigned int i = 0; i < columnsUsed.size() && i < colReaders.size(); i++) {
+    if(columnsUsed[i])
+      useColumn(i);
+  }
+}
+
+// Start keeping per-row-group state for a column, beginning with the
+// current row group.
+void ParquetCursor::useColumn(int col) {
+  columnsUsed[col] = 1;
+  // Partition columns have nothing to read
+  if(table->isPartitionColumn(col))
+    return;
+  usedColumns.push_back(col);
+
+  ColumnBatch& batch = batches[col];
+  batch.startRow = rowGroupStartRowId + 1;
+  batch.numRows = 0;
+  batch.dictionaryEncoded = false;
+}
+
+void ParquetCursor::countColumnChunk(int col) {
+  columnChunksRead++;
+  compressedBytesRead += rowGroupMetadata->ColumnChunk(col)->total_compressed_size();
 }
 
 ParquetTable* ParquetCursor::getTable() const { return table; }
 
 unsigned int ParquetCursor::getNumRowGroups() const { return numRowGroups; }
+unsigned int ParquetCursor::getNumColumnsUsed() const { return usedColumns.size(); }
+int64_t ParquetCursor::getColumnChunksRead() const { return columnChunksRead; }
+int64_t ParquetCursor::getCompressedBytesRead() const { return compressedBytesRead; }
 unsigned int ParquetCursor::getNumConstraints() const { return constraints.size(); }
 const Constraint& ParquetCursor::getConstraint(unsigned int i) const { return constraints[i]; }
+const std::vector<Constraint>& ParquetCursor::getConstraints() const { return constraints; }
+const RowGroupBitmap& ParquetCursor::getConjunction() const { return conjunction; }
 
 
+
+ColumnChunkCache::ColumnChunkCache():
+    bytes(0), maxBytes(DEFAULT_COLUMN_CACHE_BYTES), hits(0), misses(0) {
+}
+
+ColumnChunkCache& ColumnChunkCache::instance() {
+  static ColumnChunkCache cache;
+  return cache;
+}
+
+void ColumnChunkCache::remove(std::list<Entry>::iterator it, std::list<Entry>& evicted) {
+  bytes -= it->chunk->bytes;
+  byKey.erase(it->key);
+  evicted.splice(evicted.end(), entries, it);
+}
+
+void ColumnChunkCache::evict(size_t limit, std::list<Entry>& evicted) {
+  while(bytes > limit && !entries.empty())
+    remove(std::prev(entries.end()), evicted);
+}
+
+std::shared_ptr<const CachedColumnChunk> ColumnChunkCache::get(
+    const std::string& path,
+    const FileIdentity& identity,
+    int rowGroup,
+    int col) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<Key, std::list<Entry>::iterator>::iterator found = byKey.find(Key(path, rowGroup, col));
+  if(found == byKey.end()) {
+    misses++;
+    return NULL;
+  }
+
+  std::list<Entry>::iterator it = found->second;
+  if(it->identity != identity) {
+    // The file has been replaced since
+    remove(it, evicted);
+    misses++;
+    return NULL;
+  }
+
+  entries.splice(entries.begin(), entries, it);
+  hits++;
+  return it->chunk;
+}
+
+void ColumnChunkCache::put(
+    const std::string& path,
+    const FileIdentity& identity,
+    int rowGroup,
+    int col,
+    std::shared_ptr<const CachedColumnChunk> chunk) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  Key key(path, rowGroup, col);
+  std::map<Key, std::list<Entry>::iterator>::iterator found = byKey.find(key);
+  if(found != byKey.end())
+    remove(found->second, evicted);
+
+  if(chunk->bytes > maxBytes)
+    return;
+
+  entries.push_front(Entry());
+  Entry& entry = entries.front();
+  entry.key = key;
+  entry.identity = identity;
+  entry.chunk = chunk;
+  byKey[key] = entries.begin();
+  bytes += chunk->bytes;
+  evict(maxBytes, evicted);
+}
+
+bool ColumnChunkCache::isEnabled() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return maxBytes > 0;
+}
+
+size_t ColumnChunkCache::getMaxBytes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return maxBytes;
+}
+
+void ColumnChunkCache::setMaxBytes(size_t maxBytes) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  this->maxBytes = maxBytes;
+  evict(maxBytes, evicted);
+}
+
+int64_t ColumnChunkCache::getHits() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return hits;
+}
+
+int64_t ColumnChunkCache::getMisses() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return misses;
+}
@@ -1,25 +1,260 @@
 #ifndef PARQUET_CURSOR_H
 #define PARQUET_CURSOR_H
 
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 #include "parquet_filter.h"
+#include "parquet_page_reader.h"
+#include "parquet_prefetch.h"
 #include "parquet_table.h"
 #include "parquet/api/reader.h"
 
+// A run of decoded values for one column. Values are stored row-aligned:
+// slot i always describes row startRow + i, even when earlier rows were null.
+//
+// INT32, INT64, INT96 and BOOLEAN decode into intValues, FLOAT and DOUBLE
+// into doubleValues, BYTE_ARRAY and FIXED_LEN_BYTE_ARRAY into byteArrayValues.
+//
+// dictionaryEncoded is set when the values came from a dictionary-encoded
+// page, in which case each ByteArray points into the column reader's copy of
+// the dictionary, and equal values share a pointer.
+struct ColumnBatch {
+  int startRow;
+  int numRows;
+  bool dictionaryEncoded;
+  std::vector<unsigned char> nulls;
+  std::vector<int64_t> intValues;
+  std::vector<double> doubleValues;
+  std::vector<parquet::ByteArray> byteArrayValues;
+  // Owns the bytes of byteArrayValues, when they've been copied out of the
+  // page they were decoded from
+  std::vector<uint8_t> bytes;
+};
+
+// A column chunk's dictionary entries, each copied once into a buffer of
+// its own that results share with SQLite, rather than SQLite copying the
+// entry for every row that has it. Keyed like DictionaryMatches, so it too
+// must be cleared whenever the column reader is.
+//
+// Buffers are reference counted: the dictionary holds one reference, and
+// each result one more, given up by SQLite calling releaseStableValue. They
+// are NUL-terminated, so SQLite needn't copy a value to terminate it either.
+class StableDictionary {
+  struct KeyHash {
+    size_t operator()(const std::pair<const uint8_t*, uint32_t>& key) const;
+  };
+  std::unordered_map<std::pair<const uint8_t*, uint32_t>, char*, KeyHash> values;
+
+public:
+  StableDictionary();
+  StableDictionary(const StableDictionary&) = delete;
+  StableDictionary(StableDictionary&& other);
+  ~StableDictionary();
+
+  // A buffer holding ba's bytes, with a reference taken for the caller
+  const char* acquire(const parquet::ByteArray& ba);
+  void clear();
+
+  // Whether a value has a NUL in it, so SQLite can't find its end itself
+  static bool hasNul(const char* value);
+};
+
+// Give up a reference to a buffer from StableDictionary::acquire. Suitable
+// as the destructor of a SQLite result.
+void releaseStableValue(void* value);
+
+// An INT96 timestamp, as the milliseconds since the epoch the table returns
+int64_t int96toMsSinceEpoch(const parquet::Int96& rv);
+
+// A column chunk decoded in full, as kept by ColumnChunkCache. Its batches'
+// rows are numbered from 0 at the start of the row group, and byte arrays
+// point into the batches' own bytes or, for dictionary-encoded batches,
+// into dictionary, which has one copy of each entry the chunk uses.
+struct CachedColumnChunk {
+  std::vector<ColumnBatch> batches;
+  std::deque<std::string> dictionary;
+  size_t bytes;
+};
+
+// A column chunk being copied for the ColumnChunkCache as it's read
+struct RecordedChunk {
+  std::shared_ptr<CachedColumnChunk> chunk;
+  // Where each dictionary entry seen so far was copied to
+  std::unordered_map<const uint8_t*, const uint8_t*> dictionary;
+};
+
+// A process-wide cache of decoded column chunks, keyed by path, row group
+// and column, and checked against the file's identity. Scans that go over
+// the same row groups again and again, like the inner side of a join or a
+// dashboard's repeated queries, decode each column chunk once.
+//
+// Entries are kept in LRU order and evicted once their total size exceeds
+// maxBytes; 0 turns the cache off.
+class ColumnChunkCache {
+  typedef std::tuple<std::string, int, int> Key;
+  struct Entry {
+    Key key;
+    FileIdentity identity;
+    std::shared_ptr<const CachedColumnChunk> chunk;
+  };
+
+  std::mutex mutex;
+  // Most recently used at the front
+  std::list<Entry> entries;
+  std::map<Key, std::list<Entry>::iterator> byKey;
+  size_t bytes;
+  size_t maxBytes;
+  int64_t hits;
+  int64_t misses;
+
+  ColumnChunkCache();
+
+  // Must be called with mutex held. Moves entries out into evicted, so that
+  // the chunks can be freed after the lock is released.
+  void evict(size_t limit, std::list<Entry>& evicted);
+  void remove(std::list<Entry>::iterator it, std::list<Entry>& evicted);
+
+public:
+  static ColumnChunkCache& instance();
+
+  // NULL, counted as a miss, if the chunk isn't cached for this version of
+  // the file
+  std::shared_ptr<const CachedColumnChunk> get(
+      const std::string& path,
+      const FileIdentity& identity,
+      int rowGroup,
+      int col);
+  void put(
+      const std::string& path,
+      const FileIdentity& identity,
+      int rowGroup,
+      int col,
+      std::shared_ptr<const CachedColumnChunk> chunk);
+
+  bool isEnabled();
+  size_t getMaxBytes();
+  void setMaxBytes(size_t maxBytes);
+  int64_t getHits();
+  int64_t getMisses();
+};
+
+// Some columns of a row group, decoded in full by a worker thread when
+// scanning with more than one thread, or found in the ColumnChunkCache.
+struct DecodedRowGroup {
+  int rowGroupId;
+  // Dictionary-encoded values point into the column readers' dictionaries,
+  // so hang on to them.
+  std::shared_ptr<parquet::RowGroupReader> rowGroup;
+  std::vector<std::shared_ptr<parquet::ColumnReader>> colReaders;
+  // Indexed by column; the batches still to be consumed, in row order
+  std::vector<std::deque<ColumnBatch>> batches;
+  std::vector<unsigned char> decoded;
+  // The cached chunks that batches' byte arrays point into
+  std::vector<std::shared_ptr<const CachedColumnChunk>> cached;
+};
+
+// Remembers whether each dictionary entry of a column chunk satisfies a text
+// constraint, so it is evaluated once per distinct value rather than once per
+// row. Entries are keyed by the entry's address and length in the column
+// reader's dictionary, which stays put until the reader is destroyed, so the
+// cache must be cleared whenever the reader is.
+class DictionaryMatches {
+  std::vector<const uint8_t*> ptrs;
+  std::vector<uint32_t> lens;
+  std::vector<unsigned char> results;
+  size_t used;
+
+  size_t slotFor(const uint8_t* ptr, uint32_t len) const;
+  void grow();
+
+public:
+  DictionaryMatches();
+
+  // Returns the cached result for ba, or -1 if it hasn't been seen
+  int lookup(const parquet::ByteArray& ba) const;
+  void insert(const parquet::ByteArray& ba, bool result);
+  void clear();
+};
+
 class ParquetCursor {
 
   ParquetTable* table;
+  // Borrowed for the file of the row group being scanned, once a row group
+  // of it survives the filters; readerFile is -1 until then
   std::unique_ptr<parquet::ParquetFileReader> reader;
+  int readerFile;
+  // The whole file, if the table reads through a memory mapping
+  std::shared_ptr<arrow::Buffer> mapping;
+  void useFile(int file);
+  void releaseReader();
   std::unique_ptr<parquet::RowGroupMetaData> rowGroupMetadata;
   std::shared_ptr<parquet::RowGroupReader> rowGroup;
-  std::vector<std::shared_ptr<parquet::Scanner>> scanners;
+  std::vector<std::shared_ptr<parquet::ColumnReader>> colReaders;
+  // Owned by the corresponding ColumnReader
+  std::vector<ParquetPageReader*> pageReaders;
   std::vector<parquet::Type::type> types;
   std::vector<parquet::LogicalType::type> logicalTypes;
 
-  std::vector<int> colRows;
-  std::vector<bool> colNulls;
-  std::vector<int64_t> colIntValues;
-  std::vector<double> colDoubleValues;
-  std::vector<parquet::ByteArray> colByteArrayValues;
+  std::vector<ColumnBatch> batches;
+
+  // Scratch space shared by all columns for ReadBatch output that needs
+  // to be widened before it lands in a ColumnBatch.
+  std::vector<int16_t> defLevels;
+  std::vector<unsigned char> scratch;
+
+  // Columns this scan reads: those SQLite said the query uses, plus any it
+  // asks for anyway. Only these have per-row-group state to reset, and
+  // they're what gets advised, prefetched and decoded ahead. usedColumns
+  // lists the columns set in columnsUsed, less partition columns, which
+  // have nothing to read.
+  std::vector<unsigned char> columnsUsed;
+  std::vector<int> usedColumns;
+  void useColumn(int col);
+  void adviseColumnChunk(int col);
+
+  // For the life of the cursor
+  int64_t columnChunksRead;
+  int64_t compressedBytesRead;
+  void countColumnChunk(int col);
+
+  // The next row group to be scanned, being read by a helper thread
+  std::future<std::shared_ptr<PrefetchedRowGroup>> prefetch;
+  // What it read, once we've reached that row group
+  std::shared_ptr<PrefetchedRowGroup> prefetched;
+  void startPrefetch();
+  void cancelPrefetch();
+
+  // When scanning with more than one thread: the row groups being decoded
+  // by workers, in row group order, and what was decoded for this one.
+  std::deque<std::pair<int, std::future<std::shared_ptr<DecodedRowGroup>>>> decoding;
+  std::shared_ptr<DecodedRowGroup> decoded;
+  int nextRowGroupToDecode;
+  int nextRowGroupToDecodeFirstRowId;
+  // inMatchingRun, as of nextRowGroupToDecode
+  std::vector<unsigned char> inDecodeRun;
+  bool isDecoded(int col) const;
+  void scheduleDecodes();
+  void cancelDecodes();
+
+  // Per column: set while its column chunk is being read from the start
+  // without skipping, in which case recorded has standalone copies of the
+  // batches so far, to go in the ColumnChunkCache once the chunk is done.
+  // Recording stops once the copies outgrow recordingLimit, the cache's
+  // size when it started.
+  std::vector<unsigned char> recording;
+  std::vector<RecordedChunk> recorded;
+  size_t recordingLimit;
+  void startRecording(int col);
+  void stopRecording(int col);
+  bool useCachedChunk(int col);
+
+  void readBatch(int col);
+  void skipRows(int col, int64_t numRows);
+  void skipToRow(int col, int row);
 
   int rowId;
   int rowGroupId;
@@ -30,20 +265,98 @@ class ParquetCursor {
   int rowsLeftInRowGroup;
 
   bool nextRowGroup();
+  void nextRow();
+
+  // Cleared when rows of the current row group are passed over without
+  // being checked against every constraint, so a constraint that matched
+  // none of the rest may still match some of them.
+  bool rowGroupFullyChecked;
+  void recordRowGroupResults();
+
+  // Which row groups have rows satisfying all the constraints at once, as
+  // far as is known. Rows passed over unchecked fail some constraint, so
+  // unlike the constraints' own bitmaps, every row group scanned to its end
+  // counts.
+  RowGroupBitmap conjunction;
+  bool rowGroupHadRows;
+
+  // Rows still to be returned, or -1 for no limit, and rows still to be
+  // passed over before returning any
+  int64_t rowsLeftInLimit;
+  int64_t rowsToSkip;
+  void skipOffset();
+  bool limitEndsInRowGroup() const;
 
   std::vector<Constraint> constraints;
+  // One per constraint: set if it can only match a run of consecutive row
+  // groups, and if the scan has reached that run. Leaving any such run ends
+  // the scan.
+  std::vector<unsigned char> oneRun;
+  std::vector<unsigned char> inMatchingRun;
+  bool matchesOneRun(const Constraint& constraint);
+
+  // Set if some constraint bounds the rowid, so we can seek past the rows
+  // it rules out rather than filter them
+  bool seeksRowIds;
+  int nextCandidateRowId(int rowId) const;
+  bool pastMatchingRun(
+      int group,
+      const parquet::RowGroupMetaData& metadata,
+      int firstRowId,
+      std::vector<unsigned char>& inRun);
+
+  // Rowid ranges [first, end) of the current row group that hold no rows
+  // satisfying some constraint, going on the page index or data page
+  // headers, ordered by first. excludedPos is the first that may be ahead.
+  std::vector<std::pair<int, int>> excludedRows;
+  size_t excludedPos;
+  void excludePages();
+  bool pageHeaderAdmits(Constraint& constraint);
+  int pastExcludedRows(int rowId);
+  int nextCandidateRow(int rowId);
+  // One per constraint; only used by text constraints
+  std::vector<DictionaryMatches> dictionaryMatches;
+  // One per column
+  std::vector<StableDictionary> stableDictionaries;
+  // The partition value of the current file, for getByteArray
+  parquet::ByteArray partitionValue;
+
+  // Rows [selectionStartRow, selectionStartRow + selection.size()) have been
+  // filtered; selection[i] is set if row selectionStartRow + i may satisfy
+  // every constraint.
+  int selectionStartRow;
+  std::vector<unsigned char> selection;
+
+  // Per-block scratch space for the filters
+  std::vector<unsigned char> constraintMatches;
+  std::vector<int64_t> rowIdScratch;
+  std::vector<unsigned char> noNulls;
 
-  bool currentRowSatisfiesFilter();
+  void filterBlock();
   bool currentRowGroupSatisfiesFilter();
-  bool currentRowGroupSatisfiesRowIdFilter(Constraint& constraint);
-  bool currentRowGroupSatisfiesTextFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
-  bool currentRowGroupSatisfiesBlobFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
-  bool currentRowGroupSatisfiesIntegerFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
-  bool currentRowGroupSatisfiesDoubleFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
+  // The constraint that rules out the row group, the number of constraints
+  // if only the conjunction's bitmap does, or -1 if nothing does
+  int rowGroupRejectedBy(int group, const parquet::RowGroupMetaData& metadata, int firstRowId);
+  bool statisticsAdmit(Constraint& constraint, int group, const parquet::RowGroupMetaData& metadata, int firstRowId);
+  bool partitionSatisfies(const Constraint& constraint, int file);
+  bool columnStatisticsAdmit(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
+  bool pageStatisticsAdmit(
+      Constraint& constraint,
+      int64_t numRows,
+      int64_t nullCount,
+      bool hasMinMax,
+      const std::string& min,
+      const std::string& max);
+  bool bloomFilterAdmits(const Constraint& constraint, int group);
+  bool rowGroupSatisfiesRowIdFilter(Constraint& constraint, int firstRowId, int numRows);
+  bool rowGroupSatisfiesTextFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
+  bool rowGroupSatisfiesBlobFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
+  bool rowGroupSatisfiesIntegerFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
+  bool rowGroupSatisfiesDoubleFilter(Constraint& constraint, std::shared_ptr<parquet::RowGroupStatistics> stats);
 
-  bool currentRowSatisfiesTextFilter(Constraint& constraint);
-  bool currentRowSatisfiesIntegerFilter(Constraint& constraint);
-  bool currentRowSatisfiesDoubleFilter(Constraint& constraint);
+  void filterTextBlock(Constraint& constraint, DictionaryMatches& cache, int firstRow, int numRows, unsigned char* matches);
+  void filterIntegerBlock(Constraint& constraint, int firstRow, int numRows, unsigned char* matches);
+  void filterDoubleBlock(Constraint& constraint, int firstRow, int numRows, unsigned char* matches);
 
 
 public:
@@ -51,14 +364,28 @@ public:
   int getRowId();
   void next();
   void close();
-  void reset(std::vector<Constraint> constraints);
+  // limit is -1 for no limit. The offset is applied to the rows that
+  // satisfy the constraints. columnsUsed has a flag per column the query
+  // uses, or is empty if we weren't told. conjunction has what's known of
+  // the row groups that satisfy all the constraints.
+  void reset(
+      std::vector<Constraint> constraints,
+      RowGroupBitmap conjunction,
+      int64_t limit,
+      int64_t offset,
+      std::vector<unsigned char> columnsUsed);
   bool eof();
 
   void ensureColumn(int col);
   bool isNull(int col);
   unsigned int getNumRowGroups() const;
+  unsigned int getNumColumnsUsed() const;
+  int64_t getColumnChunksRead() const;
+  int64_t getCompressedBytesRead() const;
   unsigned int getNumConstraints() const;
   const Constraint& getConstraint(unsigned int i) const;
+  const std::vector<Constraint>& getConstraints() const;
+  const RowGroupBitmap& getConjunction() const;
   parquet::Type::type getPhysicalType(int col);
   parquet::LogicalType::type getLogicalType(int col);
   ParquetTable* getTable() const;
@@ -67,6 +394,10 @@ public:
   long getInt64(int col);
   double getDouble(int col);
   parquet::ByteArray* getByteArray(int col);
+  // If the current row's value of a byte array column came from a dictionary,
+  // a reference counted copy of it, which the caller must release with
+  // releaseStableValue. Otherwise NULL.
+  const char* getStableValue(int col, const parquet::ByteArray& ba);
 };
 
 #endif
@@ -1,5 +1,8 @@
 #include "parquet_filter.h"
 
+#include <algorithm>
+#include <stdio.h>
+
 Constraint::Constraint(
   RowGroupBitmap bitmap,
   int column,
@@ -17,6 +20,7 @@ Constraint::Constraint(
    intValue(intValue),
    doubleValue(doubleValue),
    blobValue(blobValue),
+   rowGroupId(-1),
    hadRows(false) {
      RowGroupBitmap bm = bitmap;
      this->bitmap = bm;
@@ -41,49 +45,96 @@ Constraint::Constraint(
   }
 }
 
-std::string Constraint::describe() const {
-  std::string rv;
-  rv.append(columnName);
-  rv.append(" ");
+const char* describeOperator(ConstraintOperator op) {
   switch(op) {
     case Equal:
-      rv.append("=");
-      break;
+      return "=";
     case GreaterThan:
-      rv.append(">");
-      break;
+      return ">";
     case LessThanOrEqual:
-      rv.append("<=");
-      break;
+      return "<=";
     case LessThan:
-      rv.append("<");
-      break;
+      return "<";
     case GreaterThanOrEqual:
-      rv.append(">=");
-      break;
+      return ">=";
     case Like:
-      rv.append("LIKE");
-      break;
+      return "LIKE";
     case Glob:
-      rv.append("GLOB");
-      break;
+      return "GLOB";
     case NotEqual:
-      rv.append("<>");
-      break;
+      return "<>";
     case IsNot:
-      rv.append("IS NOT");
-      break;
+      return "IS NOT";
     case IsNotNull:
-      rv.append("IS NOT NULL");
-      break;
+      return "IS NOT NULL";
     case IsNull:
-      rv.append("IS NULL");
-      break;
+      return "IS NULL";
     case Is:
-      rv.append("IS");
-      break;
+      return "IS";
+    case In:
+      return "IN";
+  }
+
+  return "";
+}
+
+// Quote text as an SQL literal, so a value can't be mistaken for the
+// punctuation around it
+static void appendQuoted(std::string& rv, char quote, const std::string& text) {
+  rv.push_back(quote);
+  for(size_t i = 0; i < text.size(); i++) {
+    rv.push_back(text[i]);
+    if(text[i] == quote)
+      rv.push_back(quote);
   }
+  rv.push_back(quote);
+}
+
+// Enough digits to tell any two doubles apart
+static void appendDouble(std::string& rv, double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  rv.append(buf);
+}
+
+static void appendBlob(std::string& rv, const std::vector<unsigned char>& blob) {
+  static const char hex[] = "0123456789ABCDEF";
+  rv.append("X'");
+  for(size_t i = 0; i < blob.size(); i++) {
+    rv.push_back(hex[blob[i] >> 4]);
+    rv.push_back(hex[blob[i] & 0xF]);
+  }
+  rv.append("'");
+}
+
+std::string describePrefix(const std::string& columnName, ConstraintOperator op) {
+  std::string rv;
+  appendQuoted(rv, '"', columnName);
   rv.append(" ");
+  rv.append(describeOperator(op));
+  rv.append(" ");
+  return rv;
+}
+
+std::string Constraint::describe() const {
+  std::string rv = describePrefix(columnName, op);
+
+  if(op == In) {
+    rv.append("(");
+    size_t n = type == Integer ? intValues.size() : type == Double ? doubleValues.size() : stringValues.size();
+    for(size_t i = 0; i < n; i++) {
+      if(i > 0)
+        rv.append(", ");
+      if(type == Integer)
+        rv.append(std::to_string(intValues[i]));
+      else if(type == Double)
+        appendDouble(rv, doubleValues[i]);
+      else
+        appendQuoted(rv, '\'', stringValues[i]);
+    }
+    rv.append(")");
+    return rv;
+  }
 
   switch(type) {
     case Null:
@@ -93,13 +144,26 @@ std::string Constraint::describe() const {
       rv.append(std::to_string(intValue));
       break;
     case Double:
-      rv.append(std::to_string(doubleValue));
+      appendDouble(rv, doubleValue);
       break;
     case Blob:
+      appendBlob(rv, blobValue);
       break;
     case Text:
-      rv.append(stringValue);
+      appendQuoted(rv, '\'', stringValue);
       break;
   }
   return rv;
 }
+
+template<typename T>
+static void sortAndDedupe(std::vector<T>& values) {
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+void Constraint::sortValues() {
+  sortAndDedupe(intValues);
+  sortAndDedupe(doubleValues);
+  sortAndDedupe(stringValues);
+}
@@ -17,9 +17,17 @@ enum ConstraintOperator {
   IsNot,
   IsNotNull,
   IsNull,
-  Is
+  Is,
+  In
 };
 
+// The operator as it appears in Constraint::describe(), e.g. "<="
+const char* describeOperator(ConstraintOperator op);
+
+// The start of Constraint::describe() for a constraint on columnName with
+// operator op, e.g. "col0" <=
+std::string describePrefix(const std::string& columnName, ConstraintOperator op);
+
 enum ValueType {
   Null,
   Integer,
@@ -107,12 +115,21 @@ public:
   // Only set when stringValue is set and op == Like
   std::string likeStringValue;
 
+  // Only set when op == In: the list's values, in the one matching type
+  std::vector<int64_t> intValues;
+  std::vector<double> doubleValues;
+  std::vector<std::string> stringValues;
+
+  // Sort the list's values and drop duplicates, so they can be searched
+  void sortValues();
+
   // A unique identifier for this constraint, e.g.
-  // col0 = 'Dawson Creek'
+  // "col0" = 'Dawson Creek'
+  // Names and values are quoted as in SQL, so no two constraints share one.
   std::string describe() const;
 
   // This is a temp field used while evaluating if a rowgroup had rows
-  // that matched this constraint.
+  // that matched this constraint: the row group being scanned, or -1.
   int rowGroupId;
   bool hadRows;
 };
@@ -0,0 +1,521 @@
+#include "parquet_footer.h"
+#include "parquet_bloom.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+// Thrift compact protocol field types
+static const int CT_STOP = 0;
+static const int CT_BOOLEAN_TRUE = 1;
+static const int CT_BOOLEAN_FALSE = 2;
+static const int CT_BYTE = 3;
+static const int CT_I16 = 4;
+static const int CT_I32 = 5;
+static const int CT_I64 = 6;
+static const int CT_DOUBLE = 7;
+static const int CT_BINARY = 8;
+static const int CT_LIST = 9;
+static const int CT_SET = 10;
+static const int CT_MAP = 11;
+static const int CT_STRUCT = 12;
+
+// Structs nested deeper than this are taken to be garbage
+static const int MAX_DEPTH = 64;
+
+// Field ids, from parquet.thrift
+static const int FILE_METADATA_ROW_GROUPS = 4;
+static const int ROW_GROUP_COLUMNS = 1;
+static const int ROW_GROUP_SORTING_COLUMNS = 4;
+static const int COLUMN_CHUNK_META_DATA = 3;
+static const int COLUMN_CHUNK_OFFSET_INDEX_OFFSET = 4;
+static const int COLUMN_CHUNK_OFFSET_INDEX_LENGTH = 5;
+static const int COLUMN_CHUNK_COLUMN_INDEX_OFFSET = 6;
+static const int COLUMN_CHUNK_COLUMN_INDEX_LENGTH = 7;
+static const int COLUMN_META_DATA_BLOOM_FILTER_OFFSET = 14;
+static const int COLUMN_META_DATA_BLOOM_FILTER_LENGTH = 15;
+static const int SORTING_COLUMN_COLUMN_IDX = 1;
+static const int SORTING_COLUMN_DESCENDING = 2;
+static const int SORTING_COLUMN_NULLS_FIRST = 3;
+static const int OFFSET_INDEX_PAGE_LOCATIONS = 1;
+static const int PAGE_LOCATION_FIRST_ROW_INDEX = 3;
+static const int COLUMN_INDEX_NULL_PAGES = 1;
+static const int COLUMN_INDEX_MIN_VALUES = 2;
+static const int COLUMN_INDEX_MAX_VALUES = 3;
+static const int COLUMN_INDEX_NULL_COUNTS = 5;
+static const int BLOOM_FILTER_HEADER_NUM_BYTES = 1;
+static const int BLOOM_FILTER_HEADER_ALGORITHM = 2;
+static const int BLOOM_FILTER_HEADER_HASH = 3;
+static const int BLOOM_FILTER_HEADER_COMPRESSION = 4;
+// The first, and so far only, member of each of the header's unions:
+// SplitBlockAlgorithm, XxHash and Uncompressed
+static const int BLOOM_FILTER_UNION_DEFAULT = 1;
+
+// Bloom filters bigger than this are taken to be garbage
+static const int32_t MAX_BLOOM_FILTER_BYTES = 128 * 1024 * 1024;
+
+// Just enough of Thrift's compact protocol to walk the footer, picking out
+// the fields we want and skipping the rest.
+class CompactReader {
+  const uint8_t* pos;
+  const uint8_t* end;
+
+  void fail(const char* why) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to parse footer: " << why;
+    throw std::invalid_argument(ss.str());
+  }
+
+public:
+  CompactReader(const uint8_t* data, size_t len): pos(data), end(data + len) {}
+
+  const uint8_t* position() const {
+    return pos;
+  }
+
+  uint8_t readByte() {
+    if(pos >= end)
+      fail("truncated");
+    return *pos++;
+  }
+
+  uint64_t readVarint() {
+    uint64_t rv = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+      uint8_t b = readByte();
+      rv |= (uint64_t)(b & 0x7f) << shift;
+      if(!(b & 0x80))
+        return rv;
+    }
+    fail("varint too long");
+    return 0;
+  }
+
+  int64_t readZigzag() {
+    uint64_t v = readVarint();
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+  }
+
+  // Returns false at the end of the struct. lastId is the previous field's
+  // id, which short field headers are relative to.
+  bool readFieldHeader(int& lastId, int& id, int& type) {
+    uint8_t b = readByte();
+    type = b & 0x0f;
+    if(type == CT_STOP)
+      return false;
+
+    int delta = b >> 4;
+    id = delta != 0 ? lastId + delta : (int)readZigzag();
+    lastId = id;
+    return true;
+  }
+
+  void readListHeader(int& elementType, uint64_t& size) {
+    uint8_t b = readByte();
+    elementType = b & 0x0f;
+    size = b >> 4;
+    if(size == 15)
+      size = readVarint();
+  }
+
+  std::string readBinary() {
+    uint64_t len = readVarint();
+    const uint8_t* start = pos;
+    skipBytes(len);
+    return std::string((const char*)start, len);
+  }
+
+  // A bool field carries its value in its type
+  bool readBool(int type) {
+    return type == CT_BOOLEAN_TRUE;
+  }
+
+  // Skip a value. Bools in lists take a byte; bool fields take none.
+  void skip(int type, bool inList, int depth) {
+    if(depth > MAX_DEPTH)
+      fail("nested too deeply");
+
+    switch(type) {
+      case CT_BOOLEAN_TRUE:
+      case CT_BOOLEAN_FALSE:
+        if(inList)
+          readByte();
+        break;
+      case CT_BYTE:
+        readByte();
+        break;
+      case CT_I16:
+      case CT_I32:
+      case CT_I64:
+        readVarint();
+        break;
+      case CT_DOUBLE:
+        skipBytes(8);
+        break;
+      case CT_BINARY:
+        skipBytes(readVarint());
+        break;
+      case CT_LIST:
+      case CT_SET:
+      {
+        int elementType;
+        uint64_t size;
+        readListHeader(elementType, size);
+        for(uint64_t i = 0; i < size; i++)
+          skip(elementType, true, depth + 1);
+        break;
+      }
+      case CT_MAP:
+      {
+        uint64_t size = readVarint();
+        if(size == 0)
+          break;
+        uint8_t types = readByte();
+        for(uint64_t i = 0; i < size; i++) {
+          skip(types >> 4, true, depth + 1);
+          skip(types & 0x0f, true, depth + 1);
+        }
+        break;
+      }
+      case CT_STRUCT:
+      {
+        int lastId = 0, id, fieldType;
+        while(readFieldHeader(lastId, id, fieldType))
+          skip(fieldType, false, depth + 1);
+        break;
+      }
+      default:
+        fail("unknown type");
+    }
+  }
+
+  void skipBytes(uint64_t n) {
+    if(n > (uint64_t)(end - pos))
+      fail("truncated");
+    pos += n;
+  }
+};
+
+static SortingColumn readSortingColumn(CompactReader& in) {
+  SortingColumn rv;
+  rv.column = -1;
+  rv.descending = false;
+  rv.nullsFirst = false;
+
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == SORTING_COLUMN_COLUMN_IDX && type == CT_I32)
+      rv.column = in.readZigzag();
+    else if(id == SORTING_COLUMN_DESCENDING && (type == CT_BOOLEAN_TRUE || type == CT_BOOLEAN_FALSE))
+      rv.descending = in.readBool(type);
+    else if(id == SORTING_COLUMN_NULLS_FIRST && (type == CT_BOOLEAN_TRUE || type == CT_BOOLEAN_FALSE))
+      rv.nullsFirst = in.readBool(type);
+    else
+      in.skip(type, false, 2);
+  }
+  return rv;
+}
+
+static FileRange noRange() {
+  FileRange rv;
+  rv.offset = -1;
+  rv.length = -1;
+  return rv;
+}
+
+// A ColumnMetaData, for where its bloom filter is
+static FileRange readColumnMetaData(CompactReader& in) {
+  FileRange rv = noRange();
+
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == COLUMN_META_DATA_BLOOM_FILTER_OFFSET && type == CT_I64)
+      rv.offset = in.readZigzag();
+    else if(id == COLUMN_META_DATA_BLOOM_FILTER_LENGTH && type == CT_I32)
+      rv.length = in.readZigzag();
+    else
+      in.skip(type, false, 4);
+  }
+  return rv;
+}
+
+static ColumnChunkLocations readColumnChunk(CompactReader& in) {
+  ColumnChunkLocations rv;
+  rv.bloomFilter = noRange();
+  rv.offsetIndex = noRange();
+  rv.columnIndex = noRange();
+
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == COLUMN_CHUNK_META_DATA && type == CT_STRUCT)
+      rv.bloomFilter = readColumnMetaData(in);
+    else if(id == COLUMN_CHUNK_OFFSET_INDEX_OFFSET && type == CT_I64)
+      rv.offsetIndex.offset = in.readZigzag();
+    else if(id == COLUMN_CHUNK_OFFSET_INDEX_LENGTH && type == CT_I32)
+      rv.offsetIndex.length = in.readZigzag();
+    else if(id == COLUMN_CHUNK_COLUMN_INDEX_OFFSET && type == CT_I64)
+      rv.columnIndex.offset = in.readZigzag();
+    else if(id == COLUMN_CHUNK_COLUMN_INDEX_LENGTH && type == CT_I32)
+      rv.columnIndex.length = in.readZigzag();
+    else
+      in.skip(type, false, 3);
+  }
+  return rv;
+}
+
+static void readRowGroup(CompactReader& in, Footer& footer) {
+  footer.sortingColumns.push_back(std::vector<SortingColumn>());
+  footer.columnChunks.push_back(std::vector<ColumnChunkLocations>());
+  std::vector<SortingColumn>& sortingColumns = footer.sortingColumns.back();
+  std::vector<ColumnChunkLocations>& columnChunks = footer.columnChunks.back();
+
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if((id != ROW_GROUP_SORTING_COLUMNS && id != ROW_GROUP_COLUMNS) || type != CT_LIST) {
+      in.skip(type, false, 1);
+      continue;
+    }
+
+    int elementType;
+    uint64_t size;
+    in.readListHeader(elementType, size);
+    for(uint64_t i = 0; i < size; i++) {
+      if(elementType != CT_STRUCT)
+        in.skip(elementType, true, 1);
+      else if(id == ROW_GROUP_SORTING_COLUMNS)
+        sortingColumns.push_back(readSortingColumn(in));
+      else
+        columnChunks.push_back(readColumnChunk(in));
+    }
+  }
+}
+
+static std::unique_ptr<FILE, int(*)(FILE*)> openFile(const std::string& file) {
+  std::unique_ptr<FILE, int(*)(FILE*)> fp(fopen(file.c_str(), "rb"), fclose);
+  if(fp.get() == NULL) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to open " << file;
+    throw std::invalid_argument(ss.str());
+  }
+  return fp;
+}
+
+Footer readFooter(int fd, const std::string& file) {
+  // The footer ends with its length and the magic number
+  struct stat st;
+  uint8_t tail[8];
+  if(fstat(fd, &st) != 0 ||
+      st.st_size < (off_t)sizeof(tail) ||
+      pread(fd, tail, sizeof(tail), st.st_size - sizeof(tail)) != (ssize_t)sizeof(tail) ||
+      memcmp(tail + 4, "PAR1", 4) != 0) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": " << file << " doesn't end with a Parquet footer";
+    throw std::invalid_argument(ss.str());
+  }
+
+  uint32_t len = tail[0] | (tail[1] << 8) | (tail[2] << 16) | ((uint32_t)tail[3] << 24);
+  std::vector<uint8_t> footer(len);
+  if(len == 0 ||
+      st.st_size < 8 + (off_t)len ||
+      pread(fd, &footer[0], len, st.st_size - 8 - len) != (ssize_t)len) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to read the footer of " << file;
+    throw std::invalid_argument(ss.str());
+  }
+
+  Footer rv;
+  rv.hash = xxHash64(&footer[0], footer.size());
+  CompactReader in(&footer[0], footer.size());
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id != FILE_METADATA_ROW_GROUPS || type != CT_LIST) {
+      in.skip(type, false, 0);
+      continue;
+    }
+
+    int elementType;
+    uint64_t size;
+    in.readListHeader(elementType, size);
+    for(uint64_t i = 0; i < size; i++) {
+      if(elementType == CT_STRUCT)
+        readRowGroup(in, rv);
+      else
+        in.skip(elementType, true, 0);
+    }
+  }
+  return rv;
+}
+
+// Whether a union in the header holds its default member, the only one
+// the format defines so far
+static bool readDefaultUnion(CompactReader& in) {
+  bool rv = false;
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == BLOOM_FILTER_UNION_DEFAULT && type == CT_STRUCT)
+      rv = true;
+    in.skip(type, false, 1);
+  }
+  return rv;
+}
+
+std::vector<uint8_t> readBloomFilter(const std::string& file, const FileRange& location) {
+  std::unique_ptr<FILE, int(*)(FILE*)> fp = openFile(file);
+
+  // The recorded length covers the header and the bitset. Without one,
+  // read enough to hold any header we'd accept, and the bitset after it.
+  size_t headerLen = location.length > 0 ? location.length : 256;
+  std::vector<uint8_t> header(headerLen);
+  if(location.offset < 0 || fseeko(fp.get(), location.offset, SEEK_SET) != 0) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to seek to the bloom filter at " <<
+      location.offset << " in " << file;
+    throw std::invalid_argument(ss.str());
+  }
+  header.resize(fread(&header[0], 1, header.size(), fp.get()));
+
+  CompactReader in(header.data(), header.size());
+  int32_t numBytes = -1;
+  bool understood = true;
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == BLOOM_FILTER_HEADER_NUM_BYTES && type == CT_I32)
+      numBytes = in.readZigzag();
+    else if((id == BLOOM_FILTER_HEADER_ALGORITHM ||
+          id == BLOOM_FILTER_HEADER_HASH ||
+          id == BLOOM_FILTER_HEADER_COMPRESSION) && type == CT_STRUCT)
+      understood = readDefaultUnion(in) && understood;
+    else
+      in.skip(type, false, 0);
+  }
+
+  // Split blocks are 32 bytes
+  if(!understood || numBytes <= 0 || numBytes % 32 != 0 || numBytes > MAX_BLOOM_FILTER_BYTES) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unsupported bloom filter at " <<
+      location.offset << " in " << file;
+    throw std::invalid_argument(ss.str());
+  }
+
+  size_t consumed = in.position() - header.data();
+  if(consumed + numBytes <= header.size())
+    return std::vector<uint8_t>(header.begin() + consumed, header.begin() + consumed + numBytes);
+
+  std::vector<uint8_t> rv(numBytes);
+  if(fseeko(fp.get(), location.offset + consumed, SEEK_SET) != 0 ||
+      fread(&rv[0], 1, rv.size(), fp.get()) != rv.size()) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to read the bloom filter at " <<
+      location.offset << " in " << file;
+    throw std::invalid_argument(ss.str());
+  }
+  return rv;
+}
+
+static std::vector<uint8_t> readFileRange(FILE* fp, const std::string& file, const FileRange& range) {
+  std::vector<uint8_t> rv(range.length > 0 ? range.length : 0);
+  if(range.offset < 0 ||
+      rv.empty() ||
+      fseeko(fp, range.offset, SEEK_SET) != 0 ||
+      fread(&rv[0], 1, rv.size(), fp) != rv.size()) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to read " << range.length <<
+      " bytes at " << range.offset << " in " << file;
+    throw std::invalid_argument(ss.str());
+  }
+  return rv;
+}
+
+static int64_t readPageLocation(CompactReader& in) {
+  int64_t rv = -1;
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id == PAGE_LOCATION_FIRST_ROW_INDEX && type == CT_I64)
+      rv = in.readZigzag();
+    else
+      in.skip(type, false, 2);
+  }
+  return rv;
+}
+
+static void readOffsetIndex(CompactReader& in, PageIndex& index) {
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(id != OFFSET_INDEX_PAGE_LOCATIONS || type != CT_LIST) {
+      in.skip(type, false, 0);
+      continue;
+    }
+
+    int elementType;
+    uint64_t size;
+    in.readListHeader(elementType, size);
+    for(uint64_t i = 0; i < size; i++) {
+      if(elementType == CT_STRUCT)
+        index.firstRows.push_back(readPageLocation(in));
+      else
+        in.skip(elementType, true, 1);
+    }
+  }
+}
+
+static void readColumnIndex(CompactReader& in, PageIndex& index) {
+  int lastId = 0, id, type;
+  while(in.readFieldHeader(lastId, id, type)) {
+    if(type != CT_LIST) {
+      in.skip(type, false, 0);
+      continue;
+    }
+
+    int elementType;
+    uint64_t size;
+    in.readListHeader(elementType, size);
+    for(uint64_t i = 0; i < size; i++) {
+      if(id == COLUMN_INDEX_NULL_PAGES && (elementType == CT_BOOLEAN_TRUE || elementType == CT_BOOLEAN_FALSE))
+        // Bools in lists take a byte each
+        index.nullPages.push_back(in.readByte() == CT_BOOLEAN_TRUE);
+      else if(id == COLUMN_INDEX_MIN_VALUES && elementType == CT_BINARY)
+        index.minValues.push_back(in.readBinary());
+      else if(id == COLUMN_INDEX_MAX_VALUES && elementType == CT_BINARY)
+        index.maxValues.push_back(in.readBinary());
+      else if(id == COLUMN_INDEX_NULL_COUNTS && elementType == CT_I64)
+        index.nullCounts.push_back(in.readZigzag());
+      else
+        in.skip(elementType, true, 1);
+    }
+  }
+}
+
+PageIndex readPageIndex(const std::string& file, const ColumnChunkLocations& chunk) {
+  std::unique_ptr<FILE, int(*)(FILE*)> fp = openFile(file);
+
+  PageIndex rv;
+  std::vector<uint8_t> bytes = readFileRange(fp.get(), file, chunk.offsetIndex);
+  CompactReader offsetIndex(&bytes[0], bytes.size());
+  readOffsetIndex(offsetIndex, rv);
+
+  bytes = readFileRange(fp.get(), file, chunk.columnIndex);
+  CompactReader columnIndex(&bytes[0], bytes.size());
+  readColumnIndex(columnIndex, rv);
+
+  size_t numPages = rv.firstRows.size();
+  bool consistent = numPages > 0 &&
+    rv.nullPages.size() == numPages &&
+    rv.minValues.size() == numPages &&
+    rv.maxValues.size() == numPages &&
+    (rv.nullCounts.empty() || rv.nullCounts.size() == numPages);
+  for(size_t i = 0; consistent && i < numPages; i++)
+    consistent = rv.firstRows[i] >= 0 && (i == 0 || rv.firstRows[i] > rv.firstRows[i - 1]);
+
+  if(!consistent) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": inconsistent page index at " <<
+      chunk.columnIndex.offset << " in " << file;
+    throw std::invalid_argument(ss.str());
+  }
+  return rv;
+}
@@ -0,0 +1,72 @@
+#ifndef PARQUET_FOOTER_H
+#define PARQUET_FOOTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A column that a row group's rows are sorted by, as its writer recorded it.
+struct SortingColumn {
+  int column;
+  bool descending;
+  bool nullsFirst;
+};
+
+// Where something is in the file.
+struct FileRange {
+  // -1 if it isn't there
+  int64_t offset;
+  // -1 if the writer didn't say
+  int32_t length;
+};
+
+// Where the structures that describe a column chunk, besides its metadata,
+// are in the file.
+struct ColumnChunkLocations {
+  // Its length covers the filter's header and bitset together
+  FileRange bloomFilter;
+  FileRange offsetIndex;
+  FileRange columnIndex;
+};
+
+// What we want from the footer of a Parquet file that parquet-cpp parses,
+// but doesn't expose.
+struct Footer {
+  // xxHash64 of the footer's bytes, so a rewritten file can be told apart
+  // from the one something was learnt about; 0 if it couldn't be read
+  uint64_t hash;
+  // Indexed by row group; a row group that doesn't declare a sort order has
+  // an empty list.
+  std::vector<std::vector<SortingColumn>> sortingColumns;
+  // Indexed by row group, then column
+  std::vector<std::vector<ColumnChunkLocations>> columnChunks;
+};
+
+// A column chunk's page index: its ColumnIndex and OffsetIndex together.
+// Each vector has an entry per data page, in order.
+struct PageIndex {
+  // The row, relative to the row group, that each page starts at
+  std::vector<int64_t> firstRows;
+  // Set for pages that hold only nulls, whose min and max are meaningless
+  std::vector<unsigned char> nullPages;
+  // Plain-encoded, as in statistics
+  std::vector<std::string> minValues;
+  std::vector<std::string> maxValues;
+  // Empty if the writer didn't record them
+  std::vector<int64_t> nullCounts;
+};
+
+// Read the footer of the file open on fd; file names it in errors. Throws
+// if the footer can't be read or doesn't parse.
+Footer readFooter(int fd, const std::string& file);
+
+// Read the bitset of a column chunk's bloom filter. Throws if it can't be
+// read, or isn't a split-block filter of xxHash64 hashes stored uncompressed,
+// which is all the format defines so far.
+std::vector<uint8_t> readBloomFilter(const std::string& file, const FileRange& location);
+
+// Read a column chunk's page index. Throws if it lacks one, or it can't be
+// read or doesn't parse.
+PageIndex readPageIndex(const std::string& file, const ColumnChunkLocations& chunk);
+
+#endif
@@ -0,0 +1,208 @@
+#include "parquet_metadata.h"
+#include "parquet_cursor.h"
+
+StatisticsValue::StatisticsValue(): type(Null), intValue(0), doubleValue(0) {
+}
+
+template<typename DType>
+static const typename DType::c_type& bound(parquet::RowGroupStatistics* _stats, bool max) {
+  parquet::TypedRowGroupStatistics<DType>* stats =
+    (parquet::TypedRowGroupStatistics<DType>*)_stats;
+  return max ? stats->max() : stats->min();
+}
+
+// Convert the min or max of a column chunk's statistics the way the cursor
+// converts the column's values.
+static StatisticsValue toValue(
+    parquet::RowGroupStatistics* stats,
+    const parquet::ColumnDescriptor* descr,
+    bool max) {
+  StatisticsValue rv;
+  switch(descr->physical_type()) {
+    case parquet::Type::BOOLEAN:
+      rv.type = Integer;
+      rv.intValue = bound<parquet::BooleanType>(stats, max);
+      break;
+    case parquet::Type::INT32:
+      rv.type = Integer;
+      rv.intValue = bound<parquet::Int32Type>(stats, max);
+      break;
+    case parquet::Type::INT64:
+      rv.type = Integer;
+      rv.intValue = bound<parquet::Int64Type>(stats, max);
+      break;
+    case parquet::Type::INT96:
+      rv.type = Integer;
+      rv.intValue = int96toMsSinceEpoch(bound<parquet::Int96Type>(stats, max));
+      break;
+    case parquet::Type::FLOAT:
+      rv.type = Double;
+      rv.doubleValue = bound<parquet::FloatType>(stats, max);
+      break;
+    case parquet::Type::DOUBLE:
+      rv.type = Double;
+      rv.doubleValue = bound<parquet::DoubleType>(stats, max);
+      break;
+    case parquet::Type::BYTE_ARRAY:
+    {
+      const parquet::ByteArray& ba = bound<parquet::ByteArrayType>(stats, max);
+      rv.type = descr->logical_type() == parquet::LogicalType::UTF8 ? Text : Blob;
+      rv.bytes.assign((const char*)ba.ptr, ba.len);
+      break;
+    }
+    case parquet::Type::FIXED_LEN_BYTE_ARRAY:
+    {
+      const parquet::FixedLenByteArray& flba = bound<parquet::FLBAType>(stats, max);
+      rv.type = Blob;
+      rv.bytes.assign((const char*)flba.ptr, descr->type_length());
+      break;
+    }
+    default:
+      break;
+  }
+  return rv;
+}
+
+// As SQLite orders them; a and b come from the same column, so share a type.
+// Strings compare bytewise, as with the BINARY collation.
+static bool lessThan(const StatisticsValue& a, const StatisticsValue& b) {
+  switch(a.type) {
+    case Integer:
+      return a.intValue < b.intValue;
+    case Double:
+      return a.doubleValue < b.doubleValue;
+    case Text:
+    case Blob:
+      return a.bytes < b.bytes;
+    default:
+      return false;
+  }
+}
+
+static void addName(std::string& list, const std::string& name) {
+  std::string::size_type pos = 0;
+  while(pos <= list.size()) {
+    std::string::size_type end = list.find(',', pos);
+    if(end == std::string::npos)
+      end = list.size();
+    if(list.compare(pos, end - pos, name) == 0)
+      return;
+    pos = end + 1;
+  }
+
+  if(!list.empty())
+    list += ",";
+  list += name;
+}
+
+static void addNames(std::string& list, const std::string& names) {
+  std::string::size_type pos = 0;
+  while(pos < names.size()) {
+    std::string::size_type end = names.find(',', pos);
+    if(end == std::string::npos)
+      end = names.size();
+    addName(list, names.substr(pos, end - pos));
+    pos = end + 1;
+  }
+}
+
+static MetadataRow makeRollup(const std::string& file, int rowGroup, int column) {
+  MetadataRow row;
+  row.file = file;
+  row.rowGroup = rowGroup;
+  row.column = column;
+  row.numRows = 0;
+  row.numValues = column == -1 ? -1 : 0;
+  row.nullCount = column == -1 ? -1 : 0;
+  row.compressedSize = 0;
+  row.uncompressedSize = 0;
+  return row;
+}
+
+// Add a row, of a column chunk or a row group, to a rollup over row groups.
+static void rollUp(MetadataRow& into, const MetadataRow& row, bool first) {
+  into.numRows += row.numRows;
+  if(into.numValues != -1)
+    into.numValues += row.numValues;
+  if(into.nullCount != -1)
+    into.nullCount = row.nullCount == -1 ? -1 : into.nullCount + row.nullCount;
+  into.compressedSize += row.compressedSize;
+  into.uncompressedSize += row.uncompressedSize;
+  addNames(into.encodings, row.encodings);
+  addNames(into.compression, row.compression);
+
+  // The file's range is known only if every row group's is
+  if(first) {
+    into.min = row.min;
+    into.max = row.max;
+  } else if(into.min.type != Null && row.min.type != Null) {
+    if(lessThan(row.min, into.min))
+      into.min = row.min;
+    if(lessThan(into.max, row.max))
+      into.max = row.max;
+  } else {
+    into.min = into.max = StatisticsValue();
+  }
+}
+
+static void describeFile(ParquetTable& table, int fileIndex, std::vector<MetadataRow>& rows) {
+  const TableFile& file = table.getTableFile(fileIndex);
+  const parquet::SchemaDescriptor* schema = table.getSchema();
+  int numColumns = table.getNumFileColumns();
+  int numRowGroups = file.metadata->num_row_groups();
+
+  std::vector<MetadataRow> columnRollups;
+  for(int col = 0; col < numColumns; col++)
+    columnRollups.push_back(makeRollup(file.path, -1, col));
+  MetadataRow fileRollup = makeRollup(file.path, -1, -1);
+
+  for(int i = 0; i < numRowGroups; i++) {
+    std::unique_ptr<parquet::RowGroupMetaData> rowGroup = file.metadata->RowGroup(i);
+    MetadataRow groupRollup = makeRollup(file.path, i, -1);
+    groupRollup.numRows = rowGroup->num_rows();
+
+    for(int col = 0; col < numColumns; col++) {
+      std::unique_ptr<parquet::ColumnChunkMetaData> chunk = rowGroup->ColumnChunk(col);
+      MetadataRow row;
+      row.file = file.path;
+      row.rowGroup = i;
+      row.column = col;
+      row.numRows = rowGroup->num_rows();
+      row.numValues = chunk->num_values();
+      row.nullCount = -1;
+      if(chunk->is_stats_set()) {
+        std::shared_ptr<parquet::RowGroupStatistics> stats = chunk->statistics();
+        row.nullCount = stats->null_count();
+        if(stats->HasMinMax()) {
+          row.min = toValue(stats.get(), schema->Column(col), false);
+          row.max = toValue(stats.get(), schema->Column(col), true);
+        }
+      }
+      row.compressedSize = chunk->total_compressed_size();
+      row.uncompressedSize = chunk->total_uncompressed_size();
+      for(unsigned int e = 0; e < chunk->encodings().size(); e++)
+        addName(row.encodings, parquet::EncodingToString(chunk->encodings()[e]));
+      row.compression = parquet::CompressionToString(chunk->compression());
+
+      groupRollup.compressedSize += row.compressedSize;
+      groupRollup.uncompressedSize += row.uncompressedSize;
+      addNames(groupRollup.encodings, row.encodings);
+      addNames(groupRollup.compression, row.compression);
+      rollUp(columnRollups[col], row, i == 0);
+      rows.push_back(row);
+    }
+
+    rollUp(fileRollup, groupRollup, i == 0);
+    rows.push_back(groupRollup);
+  }
+
+  rows.insert(rows.end(), columnRollups.begin(), columnRollups.end());
+  rows.push_back(fileRollup);
+}
+
+std::vector<MetadataRow> describeTable(ParquetTable& table) {
+  std::vector<MetadataRow> rows;
+  for(unsigned int i = 0; i < table.getNumFiles(); i++)
+    describeFile(table, i, rows);
+  return rows;
+}
@@ -0,0 +1,53 @@
+#ifndef PARQUET_METADATA_H
+#define PARQUET_METADATA_H
+
+#include <string>
+#include <vector>
+#include "parquet_filter.h"
+#include "parquet_table.h"
+
+// A min or max from a column's statistics, as the table would return it
+// for a row holding that value.
+struct StatisticsValue {
+  // Null if the statistics don't say
+  ValueType type;
+  int64_t intValue;
+  double doubleValue;
+  // For Text and Blob
+  std::string bytes;
+
+  StatisticsValue();
+};
+
+// A row of parquet_metadata: what a file's footer says about a column
+// chunk, or the sum of it over a file's row groups, a row group's columns,
+// or both.
+struct MetadataRow {
+  std::string file;
+  // -1 for a rollup over the file's row groups
+  int rowGroup;
+  // -1 for a rollup over the row group's columns
+  int column;
+  int64_t numRows;
+  // Values, nulls included, in the column chunk; -1 for rollups over
+  // columns
+  int64_t numValues;
+  // -1 if some column chunk has no statistics, or this is a rollup over
+  // columns
+  int64_t nullCount;
+  StatisticsValue min;
+  StatisticsValue max;
+  int64_t compressedSize;
+  int64_t uncompressedSize;
+  // Comma-separated, each listed once, in the order first seen
+  std::string encodings;
+  std::string compression;
+};
+
+// Describe each of the table's files, in the table's order. Each file's
+// rows are its column chunks by row group, each row group followed by its
+// rollup over columns, then the file's rollups over row groups for each
+// column, then its rollup over both.
+std::vector<MetadataRow> describeTable(ParquetTable& table);
+
+#endif
@@ -0,0 +1,48 @@
+#include "parquet_page_reader.h"
+
+ParquetPageReader::ParquetPageReader(std::unique_ptr<parquet::PageReader> pageReader):
+  pageReader(std::move(pageReader)),
+  pageFirstRow(0),
+  pageEndRow(0),
+  pageDictionaryEncoded(false),
+  skipUntilRow(0) {
+}
+
+std::shared_ptr<parquet::Page> ParquetPageReader::NextPage() {
+  while(true) {
+    std::shared_ptr<parquet::Page> page = pageReader->NextPage();
+
+    // Dictionary pages (and anything else that isn't a v1 data page) go
+    // straight through to the ColumnReader.
+    if(page == NULL || page->type() != parquet::PageType::DATA_PAGE)
+      return page;
+
+    parquet::DataPage* dataPage = (parquet::DataPage*)page.get();
+    int64_t numRows = dataPage->num_values();
+    int64_t firstRow = pageEndRow;
+    pageEndRow += numRows;
+
+    if(pageEndRow <= skipUntilRow)
+      continue;
+
+    pageFirstRow = firstRow;
+    pageDictionaryEncoded =
+      dataPage->encoding() == parquet::Encoding::PLAIN_DICTIONARY ||
+      dataPage->encoding() == parquet::Encoding::RLE_DICTIONARY;
+    pageStatistics = dataPage->statistics();
+    return page;
+  }
+}
+
+void ParquetPageReader::set_max_page_header_size(uint32_t size) {
+  pageReader->set_max_page_header_size(size);
+}
+
+void ParquetPageReader::skipPagesBefore(int64_t row) {
+  skipUntilRow = row;
+}
+
+int64_t ParquetPageReader::getPageFirstRow() const { return pageFirstRow; }
+int64_t ParquetPageReader::getPageEndRow() const { return pageEndRow; }
+bool ParquetPageReader::isPageDictionaryEncoded() const { return pageDictionaryEncoded; }
+const parquet::EncodedStatistics& ParquetPageReader::getPageStatistics() const { return pageStatistics; }
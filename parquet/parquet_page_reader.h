@@ -0,0 +1,45 @@
+#ifndef PARQUET_PAGE_READER_H
+#define PARQUET_PAGE_READER_H
+
+#include "parquet/api/reader.h"
+
+// Wraps the PageReader of a single column chunk and tracks which rows each
+// data page holds. Since we only support flat columns, a data page's
+// num_values is also its number of rows.
+//
+// This lets the cursor drop whole data pages that it knows it won't need
+// before the ColumnReader gets a chance to decode them.
+//
+// Row numbers are relative to the start of the row group.
+class ParquetPageReader : public parquet::PageReader {
+  std::unique_ptr<parquet::PageReader> pageReader;
+
+  // The row range of the data page most recently handed out
+  int64_t pageFirstRow;
+  int64_t pageEndRow;
+
+  // Whether that data page holds indices into the chunk's dictionary
+  bool pageDictionaryEncoded;
+
+  // And what its header says about its values
+  parquet::EncodedStatistics pageStatistics;
+
+  // Data pages that end at or before this row are dropped
+  int64_t skipUntilRow;
+
+public:
+  ParquetPageReader(std::unique_ptr<parquet::PageReader> pageReader);
+
+  std::shared_ptr<parquet::Page> NextPage() override;
+  void set_max_page_header_size(uint32_t size) override;
+
+  // Drop any data pages that end at or before row, rather than returning them.
+  void skipPagesBefore(int64_t row);
+
+  int64_t getPageFirstRow() const;
+  int64_t getPageEndRow() const;
+  bool isPageDictionaryEncoded() const;
+  const parquet::EncodedStatistics& getPageStatistics() const;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "parquet_prefetch.h"
+
+#include <string.h>
+
+// SerializedPageReader decompresses every page into the same buffer, so a
+// page from a compressed chunk is only good until the next call to NextPage.
+// Returns NULL for page types we don't know how to rebuild.
+static std::shared_ptr<parquet::Page> copyPage(const std::shared_ptr<parquet::Page>& page) {
+  std::shared_ptr<arrow::Buffer> buffer;
+  if(!arrow::AllocateBuffer(arrow::default_memory_pool(), page->size(), &buffer).ok())
+    return NULL;
+  memcpy(buffer->mutable_data(), page->data(), page->size());
+
+  switch(page->type()) {
+    case parquet::PageType::DATA_PAGE:
+    {
+      parquet::DataPage* dataPage = (parquet::DataPage*)page.get();
+      return std::make_shared<parquet::DataPage>(
+          buffer,
+          dataPage->num_values(),
+          dataPage->encoding(),
+          dataPage->definition_level_encoding(),
+          dataPage->repetition_level_encoding(),
+          dataPage->statistics());
+    }
+    case parquet::PageType::DICTIONARY_PAGE:
+    {
+      parquet::DictionaryPage* dictionaryPage = (parquet::DictionaryPage*)page.get();
+      return std::make_shared<parquet::DictionaryPage>(
+          buffer,
+          dictionaryPage->num_values(),
+          dictionaryPage->encoding(),
+          dictionaryPage->is_sorted());
+    }
+    default:
+      return NULL;
+  }
+}
+
+std::shared_ptr<PrefetchedRowGroup> prefetchRowGroup(
+    parquet::ParquetFileReader* reader,
+    int rowGroupId,
+    std::vector<int> columns) {
+  std::shared_ptr<PrefetchedRowGroup> rv(new PrefetchedRowGroup());
+  rv->rowGroupId = rowGroupId;
+
+  try {
+    std::unique_ptr<parquet::RowGroupMetaData> rowGroupMetadata = reader->metadata()->RowGroup(rowGroupId);
+    std::shared_ptr<parquet::RowGroupReader> rowGroup = reader->RowGroup(rowGroupId);
+    int numColumns = rowGroupMetadata->num_columns();
+    rv->pages.resize(numColumns);
+    rv->fetched.resize(numColumns);
+
+    for(unsigned int i = 0; i < columns.size(); i++) {
+      int col = columns[i];
+      if(col < 0 || col >= numColumns)
+        continue;
+
+      try {
+        bool compressed =
+          rowGroupMetadata->ColumnChunk(col)->compression() != parquet::Compression::UNCOMPRESSED;
+        std::unique_ptr<parquet::PageReader> pageReader = rowGroup->GetColumnPageReader(col);
+        std::vector<std::shared_ptr<parquet::Page>> pages;
+        bool ok = true;
+
+        while(true) {
+          std::shared_ptr<parquet::Page> page = pageReader->NextPage();
+          if(page == NULL)
+            break;
+
+          if(compressed) {
+            page = copyPage(page);
+            if(page == NULL) {
+              ok = false;
+              break;
+            }
+          }
+          pages.push_back(page);
+        }
+
+        if(ok) {
+          rv->pages[col].swap(pages);
+          rv->fetched[col] = 1;
+        }
+      } catch(std::exception& e) {
+        // Leave it for the cursor to read, and fail, itself
+      }
+    }
+  } catch(std::exception& e) {
+  }
+
+  return rv;
+}
+
+PrefetchedPageReader::PrefetchedPageReader(std::vector<std::shared_ptr<parquet::Page>> pages):
+  pages(pages),
+  nextPage(0) {
+}
+
+std::shared_ptr<parquet::Page> PrefetchedPageReader::NextPage() {
+  if(nextPage >= pages.size())
+    return NULL;
+
+  // Let go of pages as they're consumed
+  std::shared_ptr<parquet::Page> page;
+  page.swap(pages[nextPage++]);
+  return page;
+}
+
+void PrefetchedPageReader::set_max_page_header_size(uint32_t size) {
+}
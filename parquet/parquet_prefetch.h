@@ -0,0 +1,40 @@
+#ifndef PARQUET_PREFETCH_H
+#define PARQUET_PREFETCH_H
+
+#include <future>
+#include <vector>
+#include "parquet/api/reader.h"
+
+// The pages of some of a row group's column chunks, read (and decompressed)
+// ahead of time on a helper thread.
+struct PrefetchedRowGroup {
+  int rowGroupId;
+  // Indexed by column; empty for columns that weren't prefetched
+  std::vector<std::vector<std::shared_ptr<parquet::Page>>> pages;
+  std::vector<unsigned char> fetched;
+};
+
+// Read every page of the given columns of a row group. Meant to be run with
+// std::async while the cursor scans the row group before it.
+//
+// The reader must outlive the call. Failures aren't reported: the affected
+// columns are just left unfetched, and the cursor reads them itself, which
+// surfaces the error on the right thread.
+std::shared_ptr<PrefetchedRowGroup> prefetchRowGroup(
+    parquet::ParquetFileReader* reader,
+    int rowGroupId,
+    std::vector<int> columns);
+
+// Hands out pages that were prefetched, as if reading them from the file.
+class PrefetchedPageReader : public parquet::PageReader {
+  std::vector<std::shared_ptr<parquet::Page>> pages;
+  size_t nextPage;
+
+public:
+  PrefetchedPageReader(std::vector<std::shared_ptr<parquet::Page>> pages);
+
+  std::shared_ptr<parquet::Page> NextPage() override;
+  void set_max_page_header_size(uint32_t size) override;
+};
+
+#endif
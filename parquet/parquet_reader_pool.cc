@@ -0,0 +1,302 @@
+#include "parquet_reader_pool.h"
+
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Enough for a few hundred virtual tables to each keep a reader warm, while
+// staying well clear of the usual 1024 descriptor ulimit.
+static const size_t DEFAULT_MAX_OPEN_FILES = 256;
+
+// Room for a few hundred files with large footers
+static const size_t DEFAULT_METADATA_CACHE_BYTES = 256 * 1024 * 1024;
+
+FileIdentity FileIdentity::of(const std::string& path) {
+  struct stat st;
+  if(stat(path.c_str(), &st) != 0) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to stat " << path << ": " << strerror(errno);
+    throw std::invalid_argument(ss.str());
+  }
+
+  return of(st);
+}
+
+FileIdentity FileIdentity::of(const struct stat& st) {
+  FileIdentity identity;
+  identity.device = st.st_dev;
+  identity.inode = st.st_ino;
+  identity.size = st.st_size;
+  identity.mtimeSec = st.st_mtim.tv_sec;
+  identity.mtimeNsec = st.st_mtim.tv_nsec;
+  return identity;
+}
+
+bool FileIdentity::operator==(const FileIdentity& other) const {
+  return device == other.device &&
+    inode == other.inode &&
+    size == other.size &&
+    mtimeSec == other.mtimeSec &&
+    mtimeNsec == other.mtimeNsec;
+}
+
+bool FileIdentity::operator!=(const FileIdentity& other) const {
+  return !(*this == other);
+}
+
+ParquetReaderPool::ParquetReaderPool(): numOpen(0), maxOpenFiles(DEFAULT_MAX_OPEN_FILES) {
+}
+
+ParquetReaderPool& ParquetReaderPool::instance() {
+  static ParquetReaderPool pool;
+  return pool;
+}
+
+void ParquetReaderPool::evict(size_t limit, std::list<IdleReader>& closing) {
+  while(numOpen > limit && !idle.empty()) {
+    closing.splice(closing.end(), idle, std::prev(idle.end()));
+    numOpen--;
+  }
+}
+
+static void throwIfError(const std::string& path, const arrow::Status& status) {
+  if(!status.ok()) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to open " << path << ": " << status.ToString();
+    throw std::invalid_argument(ss.str());
+  }
+}
+
+// Holds a descriptor open for the duration of a scope
+struct ScopedFd {
+  int fd;
+  explicit ScopedFd(int fd): fd(fd) {}
+  ~ScopedFd() {
+    if(fd != -1)
+      close(fd);
+  }
+};
+
+static ParquetReaderPool::PooledReader open(
+    const std::string& path,
+    const FileIdentity& identity,
+    bool mmap,
+    std::shared_ptr<parquet::FileMetaData> metadata) {
+  ParquetReaderPool::PooledReader rv;
+
+  // metadata describes one version of the file; make sure that's the one
+  // we're opening. The readers open the file through our descriptor, so it
+  // can't be replaced between the check and the open.
+  ScopedFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if(fd.fd == -1 || fstat(fd.fd, &st) != 0) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to open " << path << ": " << strerror(errno);
+    throw std::invalid_argument(ss.str());
+  }
+
+  if(FileIdentity::of(st) != identity) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": " << path << " changed since the table was connected";
+    throw std::invalid_argument(ss.str());
+  }
+
+  // Without metadata, the reader parses the footer; get what it doesn't
+  // expose while we're at it, from the same file
+  if(metadata == NULL) {
+    try {
+      rv.footer.reset(new Footer(readFooter(fd.fd, path)));
+    } catch(std::exception& e) {
+      // It's only an optimization
+      rv.footer.reset(new Footer());
+    }
+  }
+
+  std::string fdPath = "/proc/self/fd/" + std::to_string(fd.fd);
+  if(!mmap) {
+    rv.reader = parquet::ParquetFileReader::OpenFile(
+        fdPath,
+        false,
+        parquet::default_reader_properties(),
+        metadata);
+    return rv;
+  }
+
+  std::shared_ptr<arrow::io::MemoryMappedFile> file;
+  throwIfError(path, arrow::io::MemoryMappedFile::Open(fdPath, arrow::io::FileMode::READ, &file));
+
+  // Reads from a mapped file are slices of the mapping, so this costs
+  // nothing and gives us its address.
+  int64_t size = 0;
+  throwIfError(path, file->GetSize(&size));
+  throwIfError(path, file->ReadAt(0, size, &rv.mapping));
+
+  // The default properties leave the buffered stream off, so column chunks
+  // are read with ReadAt: uncompressed pages are decoded straight out of
+  // the mapping, without a copy.
+  rv.reader = parquet::ParquetFileReader::Open(file, parquet::default_reader_properties(), metadata);
+  return rv;
+}
+
+ParquetReaderPool::PooledReader ParquetReaderPool::acquire(
+    const std::string& path,
+    const FileIdentity& identity,
+    bool mmap,
+    std::shared_ptr<parquet::FileMetaData> metadata) {
+  std::list<IdleReader> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::list<IdleReader>::iterator it = idle.begin(); metadata != NULL && it != idle.end(); it++) {
+      if(it->path == path && it->identity == identity && it->mmap == mmap) {
+        PooledReader reader = std::move(it->reader);
+        idle.erase(it);
+        return reader;
+      }
+    }
+
+    // Make room for the reader we're about to open
+    if(maxOpenFiles > 0)
+      evict(maxOpenFiles - 1, closing);
+    numOpen++;
+  }
+
+  closeReaders(closing);
+
+  try {
+    return open(path, identity, mmap, metadata);
+  } catch(...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    numOpen--;
+    throw;
+  }
+}
+
+void ParquetReaderPool::release(
+    const std::string& path,
+    const FileIdentity& identity,
+    bool mmap,
+    PooledReader reader) {
+  if(reader.reader == NULL)
+    return;
+
+  std::list<IdleReader> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.push_front(IdleReader());
+    idle.front().path = path;
+    idle.front().identity = identity;
+    idle.front().mmap = mmap;
+    idle.front().reader = std::move(reader);
+    evict(maxOpenFiles, closing);
+  }
+
+  closeReaders(closing);
+}
+
+size_t ParquetReaderPool::getMaxOpenFiles() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return maxOpenFiles;
+}
+
+void ParquetReaderPool::setMaxOpenFiles(size_t maxOpenFiles) {
+  std::list<IdleReader> closing;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->maxOpenFiles = maxOpenFiles;
+    evict(maxOpenFiles, closing);
+  }
+
+  closeReaders(closing);
+}
+
+void ParquetReaderPool::closeReaders(std::list<IdleReader>& closing) {
+  for(std::list<IdleReader>::iterator it = closing.begin(); it != closing.end(); it++) {
+    it->reader.mapping = NULL;
+    it->reader.reader->Close();
+  }
+}
+
+ParquetMetadataCache::ParquetMetadataCache(): bytes(0), maxBytes(DEFAULT_METADATA_CACHE_BYTES) {
+}
+
+ParquetMetadataCache& ParquetMetadataCache::instance() {
+  static ParquetMetadataCache cache;
+  return cache;
+}
+
+void ParquetMetadataCache::remove(std::list<Entry>::iterator it, std::list<Entry>& evicted) {
+  bytes -= it->bytes;
+  byPath.erase(it->path);
+  evicted.splice(evicted.end(), entries, it);
+}
+
+void ParquetMetadataCache::evict(size_t limit, std::list<Entry>& evicted) {
+  while(bytes > limit && !entries.empty())
+    remove(std::prev(entries.end()), evicted);
+}
+
+std::shared_ptr<parquet::FileMetaData> ParquetMetadataCache::get(
+    const std::string& path,
+    const FileIdentity& identity,
+    std::shared_ptr<const Footer>& footer) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, std::list<Entry>::iterator>::iterator found = byPath.find(path);
+  if(found == byPath.end())
+    return NULL;
+
+  std::list<Entry>::iterator it = found->second;
+  if(it->identity != identity) {
+    // The file has been replaced since
+    remove(it, evicted);
+    return NULL;
+  }
+
+  entries.splice(entries.begin(), entries, it);
+  footer = it->footer;
+  return it->metadata;
+}
+
+void ParquetMetadataCache::put(
+    const std::string& path,
+    const FileIdentity& identity,
+    std::shared_ptr<parquet::FileMetaData> metadata,
+    std::shared_ptr<const Footer> footer) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, std::list<Entry>::iterator>::iterator found = byPath.find(path);
+  if(found != byPath.end())
+    remove(found->second, evicted);
+
+  // The footer holds a little of what metadata does, so count that alone
+  size_t size = metadata->size();
+  if(size > maxBytes)
+    return;
+
+  entries.push_front(Entry());
+  Entry& entry = entries.front();
+  entry.path = path;
+  entry.identity = identity;
+  entry.metadata = metadata;
+  entry.footer = footer;
+  entry.bytes = size;
+  byPath[path] = entries.begin();
+  bytes += size;
+  evict(maxBytes, evicted);
+}
+
+size_t ParquetMetadataCache::getMaxBytes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return maxBytes;
+}
+
+void ParquetMetadataCache::setMaxBytes(size_t maxBytes) {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex);
+  this->maxBytes = maxBytes;
+  evict(maxBytes, evicted);
+}
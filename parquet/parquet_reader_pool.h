@@ -0,0 +1,159 @@
+#ifndef PARQUET_READER_POOL_H
+#define PARQUET_READER_POOL_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include "arrow/io/file.h"
+#include "parquet/api/reader.h"
+#include "parquet_footer.h"
+
+// Identifies a particular version of a file on disk. If any of these change,
+// the file has been replaced or rewritten and anything derived from the old
+// contents is stale.
+struct FileIdentity {
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t mtimeSec;
+  long mtimeNsec;
+
+  // Throws if the file can't be stat'd.
+  static FileIdentity of(const std::string& path);
+  static FileIdentity of(const struct stat& st);
+
+  bool operator==(const FileIdentity& other) const;
+  bool operator!=(const FileIdentity& other) const;
+};
+
+// A process-wide pool of open ParquetFileReaders, keyed by path and file
+// identity.
+//
+// Opening a reader costs an open(), an mmap and, without cached metadata, a
+// footer parse. xFilter runs once per outer row of a nested-loop join, so
+// cursors borrow readers from here instead of opening their own.
+//
+// A reader is used by one borrower at a time. Idle readers are kept in LRU
+// order and closed once the number of open readers exceeds maxOpenFiles.
+// Borrowed readers count towards the limit but are never taken away, so
+// it's a soft cap: a query that needs more files open at once still works.
+class ParquetReaderPool {
+public:
+  // A borrowed reader. When the file is memory mapped, mapping covers the
+  // whole file, so that the borrower can tell the kernel which parts of it
+  // are about to be read; otherwise it's NULL. footer is set when the
+  // reader parsed the metadata itself, and is read from the same file.
+  struct PooledReader {
+    std::unique_ptr<parquet::ParquetFileReader> reader;
+    std::shared_ptr<arrow::Buffer> mapping;
+    std::shared_ptr<const Footer> footer;
+  };
+
+private:
+  struct IdleReader {
+    std::string path;
+    FileIdentity identity;
+    bool mmap;
+    PooledReader reader;
+  };
+
+  std::mutex mutex;
+  // Most recently released at the front
+  std::list<IdleReader> idle;
+  // Borrowed and idle
+  size_t numOpen;
+  size_t maxOpenFiles;
+
+  ParquetReaderPool();
+
+  // Must be called with mutex held. Moves readers that should be closed
+  // into closing, so they can be closed after the lock is released.
+  void evict(size_t limit, std::list<IdleReader>& closing);
+  static void closeReaders(std::list<IdleReader>& closing);
+
+public:
+  static ParquetReaderPool& instance();
+
+  // Borrow a reader for the given version of path, reading either through
+  // a memory mapping or with pread. If metadata is given, it's used instead
+  // of parsing the footer when a new reader has to be opened; if not, a new
+  // reader is always opened, and its footer set.
+  //
+  // Callers pass the identity the file had when they read its metadata;
+  // a pooled reader keeps its file open, so it continues to agree with
+  // that metadata even if the file has since been replaced. Throws if a new
+  // reader would have to be opened and the file at path is no longer that
+  // version.
+  PooledReader acquire(
+      const std::string& path,
+      const FileIdentity& identity,
+      bool mmap,
+      std::shared_ptr<parquet::FileMetaData> metadata);
+
+  // Return a reader obtained from acquire.
+  void release(
+      const std::string& path,
+      const FileIdentity& identity,
+      bool mmap,
+      PooledReader reader);
+
+  size_t getMaxOpenFiles();
+  void setMaxOpenFiles(size_t maxOpenFiles);
+};
+
+// A process-wide cache of parsed footers, keyed by path and file identity:
+// parquet-cpp's metadata, and what readFooter got from the same version.
+//
+// Every connection connects its tables afresh, and parsing the footers of
+// large files is most of the cost of doing so. With this, connections
+// share each version of a file's metadata and parse it once.
+//
+// Entries are kept in LRU order and evicted once the footers' total size
+// exceeds maxBytes. A footer larger than that isn't kept at all.
+class ParquetMetadataCache {
+  struct Entry {
+    std::string path;
+    FileIdentity identity;
+    std::shared_ptr<parquet::FileMetaData> metadata;
+    std::shared_ptr<const Footer> footer;
+    size_t bytes;
+  };
+
+  std::mutex mutex;
+  // Most recently used at the front
+  std::list<Entry> entries;
+  std::map<std::string, std::list<Entry>::iterator> byPath;
+  size_t bytes;
+  size_t maxBytes;
+
+  ParquetMetadataCache();
+
+  // Must be called with mutex held. Moves entries out into evicted, so that
+  // the metadata can be freed after the lock is released.
+  void evict(size_t limit, std::list<Entry>& evicted);
+  void remove(std::list<Entry>::iterator it, std::list<Entry>& evicted);
+
+public:
+  static ParquetMetadataCache& instance();
+
+  // The metadata of the given version of path, or NULL if it isn't cached.
+  // Sets footer when it is.
+  std::shared_ptr<parquet::FileMetaData> get(
+      const std::string& path,
+      const FileIdentity& identity,
+      std::shared_ptr<const Footer>& footer);
+  // Replaces anything cached for another version of path
+  void put(
+      const std::string& path,
+      const FileIdentity& identity,
+      std::shared_ptr<parquet::FileMetaData> metadata,
+      std::shared_ptr<const Footer> footer);
+
+  size_t getMaxBytes();
+  void setMaxBytes(size_t maxBytes);
+};
+
+#endif
@@ -0,0 +1,572 @@
+#include "parquet_simd.h"
+
+#include <cstring>
+#include <vector>
+#include <immintrin.h>
+
+// Compare a run of values against a constant, one value at a time.
+template<typename T>
+static void compareScalar(
+    const T* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    T constraintValue,
+    unsigned char* matches) {
+  switch(op) {
+    case Is:
+    case Equal:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] == constraintValue;
+      break;
+    case IsNot:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = nulls[i] || values[i] != constraintValue;
+      break;
+    case NotEqual:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] != constraintValue;
+      break;
+    case GreaterThan:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] > constraintValue;
+      break;
+    case GreaterThanOrEqual:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] >= constraintValue;
+      break;
+    case LessThan:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] < constraintValue;
+      break;
+    case LessThanOrEqual:
+      for(int i = 0; i < numRows; i++)
+        matches[i] = !nulls[i] && values[i] <= constraintValue;
+      break;
+    default:
+      memset(matches, 1, numRows);
+      break;
+  }
+}
+
+static void compareInt64Scalar(
+    const int64_t* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    int64_t constraintValue,
+    unsigned char* matches) {
+  compareScalar(values, nulls, numRows, op, constraintValue, matches);
+}
+
+static void compareDoubleScalar(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    double constraintValue,
+    unsigned char* matches) {
+  compareScalar(values, nulls, numRows, op, constraintValue, matches);
+}
+
+// The vector kernels compute a lane bitmask per iteration. These tables
+// spread a bitmask into one 0/1 byte per lane, little-endian.
+static const uint16_t SPREAD_2[4] = {
+  0x0000, 0x0001, 0x0100, 0x0101
+};
+
+static const uint32_t SPREAD_4[16] = {
+  0x00000000, 0x00000001, 0x00000100, 0x00000101,
+  0x00010000, 0x00010001, 0x00010100, 0x00010101,
+  0x01000000, 0x01000001, 0x01000100, 0x01000101,
+  0x01010000, 0x01010001, 0x01010100, 0x01010101
+};
+
+// Combine a comparison's per-lane bytes with the lanes' null flags.
+template<typename Word>
+static inline Word applyNulls(Word compared, Word nullFlags, bool isNot, Word ones) {
+  if(isNot)
+    return compared | nullFlags;
+  return compared & ~nullFlags & ones;
+}
+
+// Rewrite an operator as a comparison the vector units support, possibly
+// with its operands swapped and/or its result inverted:
+//
+//   a != b  is  !(a == b)
+//   a <  b  is  b > a
+//   a <= b  is  !(a > b)
+//   a >= b  is  !(b > a)
+//
+// Returns false for operators that aren't comparisons.
+static bool integerComparison(ConstraintOperator op, bool* isEqual, bool* swap, bool* invert) {
+  *isEqual = false;
+  *swap = false;
+  *invert = false;
+
+  switch(op) {
+    case Is:
+    case Equal:
+      *isEqual = true;
+      return true;
+    case IsNot:
+    case NotEqual:
+      *isEqual = true;
+      *invert = true;
+      return true;
+    case GreaterThan:
+      return true;
+    case LessThan:
+      *swap = true;
+      return true;
+    case LessThanOrEqual:
+      *invert = true;
+      return true;
+    case GreaterThanOrEqual:
+      *swap = true;
+      *invert = true;
+      return true;
+    default:
+      return false;
+  }
+}
+
+__attribute__((target("sse4.2")))
+static void compareInt64SSE42(
+    const int64_t* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    int64_t constraintValue,
+    unsigned char* matches) {
+  bool isEqual, swap, invert;
+  if(!integerComparison(op, &isEqual, &swap, &invert)) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  bool isNot = op == IsNot;
+  int flip = invert ? 0x3 : 0;
+  __m128i rhs = _mm_set1_epi64x(constraintValue);
+  int i = 0;
+  for(; i + 2 <= numRows; i += 2) {
+    __m128i lhs = _mm_loadu_si128((const __m128i*)(values + i));
+    __m128i cmp;
+    if(isEqual)
+      cmp = _mm_cmpeq_epi64(lhs, rhs);
+    else if(swap)
+      cmp = _mm_cmpgt_epi64(rhs, lhs);
+    else
+      cmp = _mm_cmpgt_epi64(lhs, rhs);
+
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(cmp)) ^ flip;
+    uint16_t nullFlags;
+    memcpy(&nullFlags, nulls + i, sizeof(nullFlags));
+    uint16_t out = applyNulls<uint16_t>(SPREAD_2[mask], nullFlags, isNot, 0x0101);
+    memcpy(matches + i, &out, sizeof(out));
+  }
+
+  compareScalar(values + i, nulls + i, numRows - i, op, constraintValue, matches + i);
+}
+
+// Predicate is one of the _CMP_* immediates, which have to be compile time
+// constants. SSE lacks the immediate form, so map onto the fixed compares;
+// their NaN behaviour matches the predicates used below.
+template<int Predicate>
+__attribute__((target("sse4.2")))
+static inline __m128d compareDoubleSSE42Pd(__m128d lhs, __m128d rhs) {
+  switch(Predicate) {
+    case _CMP_EQ_OQ: return _mm_cmpeq_pd(lhs, rhs);
+    case _CMP_NEQ_UQ: return _mm_cmpneq_pd(lhs, rhs);
+    case _CMP_GT_OQ: return _mm_cmpgt_pd(lhs, rhs);
+    case _CMP_GE_OQ: return _mm_cmpge_pd(lhs, rhs);
+    case _CMP_LT_OQ: return _mm_cmplt_pd(lhs, rhs);
+    default: return _mm_cmple_pd(lhs, rhs);
+  }
+}
+
+template<int Predicate>
+__attribute__((target("sse4.2")))
+static int compareDoubleLoopSSE42(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    bool isNot,
+    double constraintValue,
+    unsigned char* matches) {
+  __m128d rhs = _mm_set1_pd(constraintValue);
+  int i = 0;
+  for(; i + 2 <= numRows; i += 2) {
+    __m128d lhs = _mm_loadu_pd(values + i);
+    int mask = _mm_movemask_pd(compareDoubleSSE42Pd<Predicate>(lhs, rhs));
+    uint16_t nullFlags;
+    memcpy(&nullFlags, nulls + i, sizeof(nullFlags));
+    uint16_t out = applyNulls<uint16_t>(SPREAD_2[mask], nullFlags, isNot, 0x0101);
+    memcpy(matches + i, &out, sizeof(out));
+  }
+  return i;
+}
+
+__attribute__((target("sse4.2")))
+static void compareDoubleSSE42(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    double constraintValue,
+    unsigned char* matches) {
+  bool isNot = op == IsNot;
+  int i = 0;
+  // Ordered predicates, except for <>, so NaN behaves as it does in C++
+  switch(op) {
+    case Is:
+    case Equal:
+      i = compareDoubleLoopSSE42<_CMP_EQ_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case IsNot:
+    case NotEqual:
+      i = compareDoubleLoopSSE42<_CMP_NEQ_UQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case GreaterThan:
+      i = compareDoubleLoopSSE42<_CMP_GT_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case GreaterThanOrEqual:
+      i = compareDoubleLoopSSE42<_CMP_GE_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case LessThan:
+      i = compareDoubleLoopSSE42<_CMP_LT_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case LessThanOrEqual:
+      i = compareDoubleLoopSSE42<_CMP_LE_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    default:
+      memset(matches, 1, numRows);
+      return;
+  }
+
+  compareScalar(values + i, nulls + i, numRows - i, op, constraintValue, matches + i);
+}
+
+__attribute__((target("avx2")))
+static void compareInt64AVX2(
+    const int64_t* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    int64_t constraintValue,
+    unsigned char* matches) {
+  bool isEqual, swap, invert;
+  if(!integerComparison(op, &isEqual, &swap, &invert)) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  bool isNot = op == IsNot;
+  int flip = invert ? 0xF : 0;
+  __m256i rhs = _mm256_set1_epi64x(constraintValue);
+  int i = 0;
+  for(; i + 4 <= numRows; i += 4) {
+    __m256i lhs = _mm256_loadu_si256((const __m256i*)(values + i));
+    __m256i cmp;
+    if(isEqual)
+      cmp = _mm256_cmpeq_epi64(lhs, rhs);
+    else if(swap)
+      cmp = _mm256_cmpgt_epi64(rhs, lhs);
+    else
+      cmp = _mm256_cmpgt_epi64(lhs, rhs);
+
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(cmp)) ^ flip;
+    uint32_t nullFlags;
+    memcpy(&nullFlags, nulls + i, sizeof(nullFlags));
+    uint32_t out = applyNulls<uint32_t>(SPREAD_4[mask], nullFlags, isNot, 0x01010101);
+    memcpy(matches + i, &out, sizeof(out));
+  }
+
+  compareScalar(values + i, nulls + i, numRows - i, op, constraintValue, matches + i);
+}
+
+template<int Predicate>
+__attribute__((target("avx2")))
+static int compareDoubleLoopAVX2(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    bool isNot,
+    double constraintValue,
+    unsigned char* matches) {
+  __m256d rhs = _mm256_set1_pd(constraintValue);
+  int i = 0;
+  for(; i + 4 <= numRows; i += 4) {
+    __m256d lhs = _mm256_loadu_pd(values + i);
+    int mask = _mm256_movemask_pd(_mm256_cmp_pd(lhs, rhs, Predicate));
+    uint32_t nullFlags;
+    memcpy(&nullFlags, nulls + i, sizeof(nullFlags));
+    uint32_t out = applyNulls<uint32_t>(SPREAD_4[mask], nullFlags, isNot, 0x01010101);
+    memcpy(matches + i, &out, sizeof(out));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static void compareDoubleAVX2(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    double constraintValue,
+    unsigned char* matches) {
+  bool isNot = op == IsNot;
+  int i = 0;
+  switch(op) {
+    case Is:
+    case Equal:
+      i = compareDoubleLoopAVX2<_CMP_EQ_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case IsNot:
+    case NotEqual:
+      i = compareDoubleLoopAVX2<_CMP_NEQ_UQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case GreaterThan:
+      i = compareDoubleLoopAVX2<_CMP_GT_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case GreaterThanOrEqual:
+      i = compareDoubleLoopAVX2<_CMP_GE_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case LessThan:
+      i = compareDoubleLoopAVX2<_CMP_LT_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    case LessThanOrEqual:
+      i = compareDoubleLoopAVX2<_CMP_LE_OQ>(values, nulls, numRows, isNot, constraintValue, matches);
+      break;
+    default:
+      memset(matches, 1, numRows);
+      return;
+  }
+
+  compareScalar(values + i, nulls + i, numRows - i, op, constraintValue, matches + i);
+}
+
+// Whether a value, given whether it's null and whether it equals the
+// target, satisfies an equality operator.
+static inline unsigned char equalityMatch(bool isNull, bool isEqual, ConstraintOperator op) {
+  switch(op) {
+    case Is:
+    case Equal:
+      return !isNull && isEqual;
+    case NotEqual:
+      return !isNull && !isEqual;
+    default:
+      return isNull || !isEqual;
+  }
+}
+
+static bool isEqualityOperator(ConstraintOperator op) {
+  return op == Equal || op == Is || op == NotEqual || op == IsNot;
+}
+
+static inline bool bytesEqualScalar(const uint8_t* a, const uint8_t* b, uint32_t len) {
+  return len == 0 || memcmp(a, b, len) == 0;
+}
+
+static void compareBytesScalar(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    const uint8_t* target,
+    uint32_t targetLen,
+    unsigned char* matches) {
+  if(!isEqualityOperator(op)) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  for(int i = 0; i < numRows; i++) {
+    bool isEqual = !nulls[i] && values[i].len == targetLen &&
+      bytesEqualScalar(values[i].ptr, target, targetLen);
+    matches[i] = equalityMatch(nulls[i], isEqual, op);
+  }
+}
+
+static void matchPrefixScalar(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    const uint8_t* prefix,
+    uint32_t prefixLen,
+    unsigned char* matches) {
+  for(int i = 0; i < numRows; i++) {
+    matches[i] = !nulls[i] && values[i].len >= prefixLen &&
+      bytesEqualScalar(values[i].ptr, prefix, prefixLen);
+  }
+}
+
+// Compare fewer than 16 bytes with word loads that overlap rather than run
+// past either buffer: the first and last 8 bytes cover 8 to 15, and so on.
+static inline bool shortBytesEqual(const uint8_t* a, const uint8_t* b, uint32_t len) {
+  if(len >= 8) {
+    uint64_t x1, y1, x2, y2;
+    memcpy(&x1, a, 8);
+    memcpy(&y1, b, 8);
+    memcpy(&x2, a + len - 8, 8);
+    memcpy(&y2, b + len - 8, 8);
+    return ((x1 ^ y1) | (x2 ^ y2)) == 0;
+  }
+  if(len >= 4) {
+    uint32_t x1, y1, x2, y2;
+    memcpy(&x1, a, 4);
+    memcpy(&y1, b, 4);
+    memcpy(&x2, a + len - 4, 4);
+    memcpy(&y2, b + len - 4, 4);
+    return ((x1 ^ y1) | (x2 ^ y2)) == 0;
+  }
+  if(len > 0)
+    return a[0] == b[0] && a[len / 2] == b[len / 2] && a[len - 1] == b[len - 1];
+  return true;
+}
+
+__attribute__((target("sse4.2")))
+static inline bool bytes16Equal(const uint8_t* a, const uint8_t* b) {
+  __m128i x = _mm_loadu_si128((const __m128i*)a);
+  __m128i y = _mm_loadu_si128((const __m128i*)b);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+// 16 bytes at a time, the last 16 overlapping the ones before if need be,
+// so nothing is read past either buffer.
+__attribute__((target("sse4.2")))
+static inline bool bytesEqualSSE42(const uint8_t* a, const uint8_t* b, uint32_t len) {
+  if(len < 16)
+    return shortBytesEqual(a, b, len);
+
+  for(uint32_t i = 0; i + 16 < len; i += 16) {
+    if(!bytes16Equal(a + i, b + i))
+      return false;
+  }
+  return bytes16Equal(a + len - 16, b + len - 16);
+}
+
+__attribute__((target("sse4.2")))
+static void compareBytesSSE42(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    const uint8_t* target,
+    uint32_t targetLen,
+    unsigned char* matches) {
+  if(!isEqualityOperator(op)) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  for(int i = 0; i < numRows; i++) {
+    bool isEqual = !nulls[i] && values[i].len == targetLen &&
+      bytesEqualSSE42(values[i].ptr, target, targetLen);
+    matches[i] = equalityMatch(nulls[i], isEqual, op);
+  }
+}
+
+__attribute__((target("sse4.2")))
+static void matchPrefixSSE42(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    const uint8_t* prefix,
+    uint32_t prefixLen,
+    unsigned char* matches) {
+  for(int i = 0; i < numRows; i++) {
+    matches[i] = !nulls[i] && values[i].len >= prefixLen &&
+      bytesEqualSSE42(values[i].ptr, prefix, prefixLen);
+  }
+}
+
+__attribute__((target("avx2")))
+static inline bool bytes32Equal(const uint8_t* a, const uint8_t* b) {
+  __m256i x = _mm256_loadu_si256((const __m256i*)a);
+  __m256i y = _mm256_loadu_si256((const __m256i*)b);
+  return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) == 0xFFFFFFFF;
+}
+
+// As bytesEqualSSE42, 32 bytes at a time.
+__attribute__((target("avx2")))
+static inline bool bytesEqualAVX2(const uint8_t* a, const uint8_t* b, uint32_t len) {
+  if(len < 16)
+    return shortBytesEqual(a, b, len);
+  if(len <= 32)
+    return bytes16Equal(a, b) && bytes16Equal(a + len - 16, b + len - 16);
+
+  for(uint32_t i = 0; i + 32 < len; i += 32) {
+    if(!bytes32Equal(a + i, b + i))
+      return false;
+  }
+  return bytes32Equal(a + len - 32, b + len - 32);
+}
+
+__attribute__((target("avx2")))
+static void compareBytesAVX2(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    const uint8_t* target,
+    uint32_t targetLen,
+    unsigned char* matches) {
+  if(!isEqualityOperator(op)) {
+    memset(matches, 1, numRows);
+    return;
+  }
+
+  for(int i = 0; i < numRows; i++) {
+    bool isEqual = !nulls[i] && values[i].len == targetLen &&
+      bytesEqualAVX2(values[i].ptr, target, targetLen);
+    matches[i] = equalityMatch(nulls[i], isEqual, op);
+  }
+}
+
+__attribute__((target("avx2")))
+static void matchPrefixAVX2(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    const uint8_t* prefix,
+    uint32_t prefixLen,
+    unsigned char* matches) {
+  for(int i = 0; i < numRows; i++) {
+    matches[i] = !nulls[i] && values[i].len >= prefixLen &&
+      bytesEqualAVX2(values[i].ptr, prefix, prefixLen);
+  }
+}
+
+static const FilterKernels SCALAR_KERNELS = {
+  "scalar", compareInt64Scalar, compareDoubleScalar, compareBytesScalar, matchPrefixScalar
+};
+static const FilterKernels SSE42_KERNELS = {
+  "sse4.2", compareInt64SSE42, compareDoubleSSE42, compareBytesSSE42, matchPrefixSSE42
+};
+static const FilterKernels AVX2_KERNELS = {
+  "avx2", compareInt64AVX2, compareDoubleAVX2, compareBytesAVX2, matchPrefixAVX2
+};
+
+static std::vector<const FilterKernels*> detectFilterKernels() {
+  std::vector<const FilterKernels*> rv;
+  rv.push_back(&SCALAR_KERNELS);
+
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse4.2"))
+    rv.push_back(&SSE42_KERNELS);
+  if(__builtin_cpu_supports("avx2"))
+    rv.push_back(&AVX2_KERNELS);
+
+  return rv;
+}
+
+const std::vector<const FilterKernels*>& supportedFilterKernels() {
+  static const std::vector<const FilterKernels*> kernels = detectFilterKernels();
+  return kernels;
+}
+
+const FilterKernels& filterKernels() {
+  static const FilterKernels& best = *supportedFilterKernels().back();
+  return best;
+}
@@ -0,0 +1,69 @@
+#ifndef PARQUET_SIMD_H
+#define PARQUET_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parquet_filter.h"
+#include "parquet/types.h"
+
+// Kernels that compare a block of decoded values against a constraint's
+// value. Each writes matches[i] = 1 if row i satisfies the comparison, and
+// 0 otherwise. Null rows (nulls[i] != 0) only satisfy IS NOT. Operators
+// that aren't comparisons (LIKE, GLOB, ...) match every row.
+//
+// INT32, BOOLEAN and INT96 columns are widened to int64 when decoded, and
+// FLOAT columns to double, so the 64-bit kernels cover every numeric type.
+typedef void (*CompareInt64Fn)(
+    const int64_t* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    int64_t constraintValue,
+    unsigned char* matches);
+
+typedef void (*CompareDoubleFn)(
+    const double* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    double constraintValue,
+    unsigned char* matches);
+
+// Byte array kernels only decide equality: =, IS, <> and IS NOT. Values are
+// compared with target bytewise, as SQLite's BINARY collation does. Loads
+// never stray past the end of a value or of target.
+typedef void (*CompareBytesFn)(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    ConstraintOperator op,
+    const uint8_t* target,
+    uint32_t targetLen,
+    unsigned char* matches);
+
+// Matches non-null values that start with prefix.
+typedef void (*MatchPrefixFn)(
+    const parquet::ByteArray* values,
+    const unsigned char* nulls,
+    int numRows,
+    const uint8_t* prefix,
+    uint32_t prefixLen,
+    unsigned char* matches);
+
+struct FilterKernels {
+  const char* name;
+  CompareInt64Fn compareInt64;
+  CompareDoubleFn compareDouble;
+  CompareBytesFn compareBytes;
+  MatchPrefixFn matchPrefix;
+};
+
+// Every implementation this CPU can run, slowest first. The scalar kernels
+// are always present.
+const std::vector<const FilterKernels*>& supportedFilterKernels();
+
+// The fastest implementation this CPU can run, picked once at startup.
+const FilterKernels& filterKernels();
+
+#endif
@@ -0,0 +1,147 @@
+// Microbenchmark for the filter kernels in parquet_simd.cc.
+//
+// Runs every comparison on random int64 and double blocks, and equality and
+// prefix matches on random byte arrays, through each kernel set this CPU
+// supports, checks that they agree with the scalar kernels, and reports the
+// throughput of each.
+//
+// Usage: bench-simd [iterations]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "parquet_simd.h"
+
+static const int BLOCK_SIZE = 4096;
+
+static const ConstraintOperator OPS[] = {
+  Equal, NotEqual, LessThan, LessThanOrEqual, GreaterThan, GreaterThanOrEqual, IsNot
+};
+
+static const char* OP_NAMES[] = {
+  "=", "<>", "<", "<=", ">", ">=", "IS NOT"
+};
+
+static const ConstraintOperator BYTE_OPS[] = { Equal, NotEqual, IsNot };
+static const char* BYTE_OP_NAMES[] = { "=", "<>", "IS NOT" };
+
+template<typename T, typename Fn>
+static double run(Fn fn, const std::vector<T>& values, const std::vector<unsigned char>& nulls,
+    ConstraintOperator op, T constraintValue, std::vector<unsigned char>& matches, int iterations) {
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < iterations; i++) {
+    fn(&values[0], &nulls[0], BLOCK_SIZE, op, constraintValue, &matches[0]);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return (double)BLOCK_SIZE * iterations / seconds / 1e6;
+}
+
+static double runBytes(const FilterKernels& kernels, bool prefix, const std::vector<parquet::ByteArray>& values,
+    const std::vector<unsigned char>& nulls, ConstraintOperator op, const std::string& target,
+    std::vector<unsigned char>& matches, int iterations) {
+  const uint8_t* ptr = (const uint8_t*)target.data();
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < iterations; i++) {
+    if(prefix)
+      kernels.matchPrefix(&values[0], &nulls[0], BLOCK_SIZE, ptr, target.size(), &matches[0]);
+    else
+      kernels.compareBytes(&values[0], &nulls[0], BLOCK_SIZE, op, ptr, target.size(), &matches[0]);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return (double)BLOCK_SIZE * iterations / seconds / 1e6;
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+
+  std::mt19937_64 rng(42);
+  std::vector<int64_t> ints(BLOCK_SIZE);
+  std::vector<double> doubles(BLOCK_SIZE);
+  std::vector<unsigned char> nulls(BLOCK_SIZE);
+  for(int i = 0; i < BLOCK_SIZE; i++) {
+    ints[i] = rng() % 1000;
+    doubles[i] = (double)(rng() % 1000) / 10;
+    nulls[i] = rng() % 10 == 0;
+  }
+
+  // Strings up to 48 bytes, so every length of tail is covered, a quarter of
+  // them the target or sharing a long prefix with it
+  std::string target = "parquet-simd-bench-target-value-0123456789";
+  std::vector<std::string> strings(BLOCK_SIZE);
+  std::vector<parquet::ByteArray> byteArrays(BLOCK_SIZE);
+  for(int i = 0; i < BLOCK_SIZE; i++) {
+    switch(rng() % 8) {
+      case 0:
+        strings[i] = target;
+        break;
+      case 1:
+        strings[i] = target.substr(0, 20 + rng() % (target.size() - 20));
+        strings[i] += (char)('a' + rng() % 3);
+        break;
+      default:
+        for(int n = rng() % 49; n > 0; n--)
+          strings[i] += (char)('a' + rng() % 3);
+        break;
+    }
+  }
+  for(int i = 0; i < BLOCK_SIZE; i++)
+    byteArrays[i] = parquet::ByteArray(strings[i].size(), (const uint8_t*)strings[i].data());
+
+  const std::vector<const FilterKernels*>& kernels = supportedFilterKernels();
+  std::vector<unsigned char> expected(BLOCK_SIZE);
+  std::vector<unsigned char> actual(BLOCK_SIZE);
+  int failures = 0;
+
+  printf("%-8s %-7s %-8s %10s\n", "type", "op", "kernels", "Mvalues/s");
+  for(unsigned int o = 0; o < sizeof(OPS) / sizeof(OPS[0]); o++) {
+    for(unsigned int k = 0; k < kernels.size(); k++) {
+      double rate = run(kernels[k]->compareInt64, ints, nulls, OPS[o], (int64_t)500, actual, iterations);
+      kernels[0]->compareInt64(&ints[0], &nulls[0], BLOCK_SIZE, OPS[o], 500, &expected[0]);
+      if(actual != expected) {
+        printf("MISMATCH: int64 %s %s\n", OP_NAMES[o], kernels[k]->name);
+        failures++;
+      }
+      printf("%-8s %-7s %-8s %10.1f\n", "int64", OP_NAMES[o], kernels[k]->name, rate);
+    }
+
+    for(unsigned int k = 0; k < kernels.size(); k++) {
+      double rate = run(kernels[k]->compareDouble, doubles, nulls, OPS[o], 50.0, actual, iterations);
+      kernels[0]->compareDouble(&doubles[0], &nulls[0], BLOCK_SIZE, OPS[o], 50.0, &expected[0]);
+      if(actual != expected) {
+        printf("MISMATCH: double %s %s\n", OP_NAMES[o], kernels[k]->name);
+        failures++;
+      }
+      printf("%-8s %-7s %-8s %10.1f\n", "double", OP_NAMES[o], kernels[k]->name, rate);
+    }
+  }
+
+  for(unsigned int o = 0; o < sizeof(BYTE_OPS) / sizeof(BYTE_OPS[0]); o++) {
+    for(unsigned int k = 0; k < kernels.size(); k++) {
+      double rate = runBytes(*kernels[k], false, byteArrays, nulls, BYTE_OPS[o], target, actual, iterations);
+      runBytes(*kernels[0], false, byteArrays, nulls, BYTE_OPS[o], target, expected, 1);
+      if(actual != expected) {
+        printf("MISMATCH: bytes %s %s\n", BYTE_OP_NAMES[o], kernels[k]->name);
+        failures++;
+      }
+      printf("%-8s %-7s %-8s %10.1f\n", "bytes", BYTE_OP_NAMES[o], kernels[k]->name, rate);
+    }
+  }
+
+  std::string prefix = target.substr(0, 24);
+  for(unsigned int k = 0; k < kernels.size(); k++) {
+    double rate = runBytes(*kernels[k], true, byteArrays, nulls, Like, prefix, actual, iterations);
+    runBytes(*kernels[0], true, byteArrays, nulls, Like, prefix, expected, 1);
+    if(actual != expected) {
+      printf("MISMATCH: bytes prefix %s\n", kernels[k]->name);
+      failures++;
+    }
+    printf("%-8s %-7s %-8s %10.1f\n", "bytes", "prefix", kernels[k]->name, rate);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
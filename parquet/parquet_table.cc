@@ -2,9 +2,272 @@
 
 #include "parquet/api/reader.h"
 
-ParquetTable::ParquetTable(std::string file, std::string tableName): file(file), tableName(tableName) {
-  std::unique_ptr<parquet::ParquetFileReader> reader = parquet::ParquetFileReader::OpenFile(file.data());
-  metadata = reader->metadata();
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <glob.h>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const int MAX_THREADS = 64;
+
+ParquetTableOptions::ParquetTableOptions(): mmap(true), threads(1) {
+}
+
+void ParquetTableOptions::parse(const std::string& arg) {
+  size_t eq = arg.find('=');
+  std::string key = arg.substr(0, eq);
+  std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+  if(key == "mmap") {
+    if(value != "0" && value != "1") {
+      std::ostringstream ss;
+      ss << __FILE__ << ":" << __LINE__ << ": mmap must be 0 or 1, not '" << value << "'";
+      throw std::invalid_argument(ss.str());
+    }
+    mmap = value == "1";
+    return;
+  }
+
+  if(key == "threads") {
+    char* end = NULL;
+    long n = strtol(value.c_str(), &end, 10);
+    if(value.empty() || *end != '\0' || n < 1 || n > MAX_THREADS) {
+      std::ostringstream ss;
+      ss << __FILE__ << ":" << __LINE__ << ": threads must be between 1 and " << MAX_THREADS <<
+        ", not '" << value << "'";
+      throw std::invalid_argument(ss.str());
+    }
+    threads = n;
+    return;
+  }
+
+  std::ostringstream ss;
+  ss << __FILE__ << ":" << __LINE__ << ": unknown option '" << arg << "'";
+  throw std::invalid_argument(ss.str());
+}
+
+static bool isDirectory(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+static bool hasGlobChars(const std::string& path) {
+  return path.find_first_of("*?[") != std::string::npos;
+}
+
+// Hidden files, and the likes of _SUCCESS and _metadata that writers leave
+// beside the data, aren't part of the table. Partition directories whose
+// key starts with an underscore are.
+static bool isDataFileName(const std::string& name) {
+  if(name.empty() || name[0] == '.')
+    return false;
+  return name[0] != '_' || name.find('=') != std::string::npos;
+}
+
+// Add the paths of the files under dir, however deep, to paths.
+static void listDirectory(std::string dir, std::vector<std::string>& paths) {
+  while(dir.size() > 1 && dir[dir.size() - 1] == '/')
+    dir.resize(dir.size() - 1);
+
+  DIR* d = opendir(dir.c_str());
+  if(d == NULL) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to read directory " << dir << ": " << strerror(errno);
+    throw std::invalid_argument(ss.str());
+  }
+  std::unique_ptr<DIR, int(*)(DIR*)> closer(d, closedir);
+
+  struct dirent* entry;
+  while((entry = readdir(d)) != NULL) {
+    std::string name = entry->d_name;
+    if(!isDataFileName(name))
+      continue;
+
+    std::string path = dir == "/" ? dir + name : dir + "/" + name;
+    if(isDirectory(path))
+      listDirectory(path, paths);
+    else
+      paths.push_back(path);
+  }
+}
+
+// Add the paths of the files a glob matches to paths, and of the files
+// under any directories it matches.
+static void expandGlob(const std::string& pattern, std::vector<std::string>& paths) {
+  glob_t matches;
+  int rc = glob(pattern.c_str(), 0, NULL, &matches);
+  if(rc != 0 && rc != GLOB_NOMATCH) {
+    globfree(&matches);
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": unable to expand " << pattern;
+    throw std::invalid_argument(ss.str());
+  }
+
+  for(size_t i = 0; rc == 0 && i < matches.gl_pathc; i++) {
+    std::string path = matches.gl_pathv[i];
+    if(isDirectory(path))
+      listDirectory(path, paths);
+    else
+      paths.push_back(path);
+  }
+  globfree(&matches);
+}
+
+static int hexDigit(char c) {
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Writers escape characters that can't appear in a path as %XX.
+static std::string unescapePathComponent(const std::string& s) {
+  std::string rv;
+  for(size_t i = 0; i < s.size(); i++) {
+    if(s[i] == '%' && i + 2 < s.size() && hexDigit(s[i + 1]) >= 0 && hexDigit(s[i + 2]) >= 0) {
+      rv += (char)(hexDigit(s[i + 1]) * 16 + hexDigit(s[i + 2]));
+      i += 2;
+    } else {
+      rv += s[i];
+    }
+  }
+  return rv;
+}
+
+// The key=value directories between base and a file, outermost first.
+static std::vector<std::pair<std::string, std::string>> partitionsOf(
+    const std::string& path,
+    const std::string& base) {
+  std::vector<std::pair<std::string, std::string>> rv;
+  size_t start = 0;
+  if(!base.empty() && path.compare(0, base.size(), base) == 0)
+    start = base.size();
+
+  while(true) {
+    while(start < path.size() && path[start] == '/')
+      start++;
+    size_t end = path.find('/', start);
+    // The last component is the file itself
+    if(end == std::string::npos)
+      break;
+
+    std::string component = path.substr(start, end - start);
+    size_t eq = component.find('=');
+    if(eq != std::string::npos && eq > 0)
+      rv.push_back(std::make_pair(
+            unescapePathComponent(component.substr(0, eq)),
+            unescapePathComponent(component.substr(eq + 1))));
+    start = end;
+  }
+  return rv;
+}
+
+// How Hive writes a null partition value
+static const char* NULL_PARTITION = "__HIVE_DEFAULT_PARTITION__";
+
+ParquetTable::ParquetTable(std::string file, std::string tableName, ParquetTableOptions options):
+    file(file), tableName(tableName), options(options) {
+  std::vector<std::string> paths;
+  std::string base;
+  bool partitioned = true;
+  if(isDirectory(file)) {
+    base = file;
+    listDirectory(file, paths);
+  } else if(!exists(file) && hasGlobChars(file)) {
+    // Partition directories start below the first component with a wildcard
+    size_t slash = file.rfind('/', file.find_first_of("*?["));
+    if(slash != std::string::npos)
+      base = file.substr(0, slash);
+    expandGlob(file, paths);
+  } else {
+    partitioned = false;
+    paths.push_back(file);
+  }
+
+  if(paths.empty()) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": no files found at " << file;
+    throw std::invalid_argument(ss.str());
+  }
+
+  std::sort(paths.begin(), paths.end());
+  rowGroupStarts.push_back(0);
+  for(unsigned int i = 0; i < paths.size(); i++) {
+    std::vector<std::pair<std::string, std::string>> partitions;
+    if(partitioned)
+      partitions = partitionsOf(paths[i], base);
+    addFile(paths[i], partitions);
+  }
+
+  // Files outside a key's directories have no value for it
+  for(unsigned int i = 0; i < files.size(); i++) {
+    files[i].partitionValues.resize(partitionKeys.size());
+    files[i].partitionNulls.resize(partitionKeys.size(), 1);
+  }
+}
+
+void ParquetTable::addFile(
+    const std::string& path,
+    const std::vector<std::pair<std::string, std::string>>& partitions) {
+  TableFile f;
+  f.path = path;
+  f.identity = FileIdentity::of(path);
+
+  // Another connection may have parsed the footer already
+  ParquetMetadataCache& cache = ParquetMetadataCache::instance();
+  f.metadata = cache.get(path, f.identity, f.footer);
+  if(f.metadata == NULL) {
+    ParquetReaderPool& pool = ParquetReaderPool::instance();
+    ParquetReaderPool::PooledReader reader;
+    try {
+      reader = pool.acquire(path, f.identity, options.mmap, NULL);
+    } catch(std::exception& e) {
+      std::ostringstream ss;
+      ss << __FILE__ << ":" << __LINE__ << ": unable to read " << path << ": " << e.what();
+      throw std::invalid_argument(ss.str());
+    }
+    f.metadata = reader.reader->metadata();
+    f.footer = reader.footer;
+    cache.put(path, f.identity, f.metadata, f.footer);
+    // Our first cursor will likely want this right back
+    pool.release(path, f.identity, options.mmap, std::move(reader));
+  }
+
+  if(!files.empty() && !f.metadata->schema()->Equals(*files[0].metadata->schema())) {
+    std::ostringstream ss;
+    ss << __FILE__ << ":" << __LINE__ << ": " << path << " has a different schema from " <<
+      files[0].path;
+    throw std::invalid_argument(ss.str());
+  }
+
+  for(unsigned int i = 0; i < partitions.size(); i++) {
+    unsigned int key = std::find(partitionKeys.begin(), partitionKeys.end(), partitions[i].first) -
+      partitionKeys.begin();
+    if(key == partitionKeys.size())
+      partitionKeys.push_back(partitions[i].first);
+    f.partitionValues.resize(partitionKeys.size());
+    f.partitionNulls.resize(partitionKeys.size(), 1);
+    f.partitionValues[key] = partitions[i].second;
+    f.partitionNulls[key] = partitions[i].second == NULL_PARTITION;
+  }
+
+  f.firstRowGroup = rowGroupFiles.size();
+  for(int i = 0; i < f.metadata->num_row_groups(); i++) {
+    rowGroupFiles.push_back(files.size());
+    rowGroupStarts.push_back(rowGroupStarts.back() + f.metadata->RowGroup(i)->num_rows());
+  }
+  files.push_back(f);
 }
 
 std::string ParquetTable::columnName(int i) {
@@ -17,15 +280,35 @@ unsigned int ParquetTable::getNumColumns() {
   return columnNames.size();
 }
 
+unsigned int ParquetTable::getNumFileColumns() {
+  return getSchema()->num_columns();
+}
+
+bool ParquetTable::isPartitionColumn(int col) {
+  return col >= (int)getNumFileColumns();
+}
+
+static void appendQuoted(std::string& text, const std::string& name) {
+  text += "\"";
+  // Horrifically inefficient, but easy to understand.
+  for(const char& c : name) {
+    if(c == '"')
+      text += "\"\"";
+    else
+      text += c;
+  }
+  text += "\"";
+}
+
+static std::string lowerCase(std::string s) {
+  for(unsigned int i = 0; i < s.size(); i++)
+    s[i] = tolower((unsigned char)s[i]);
+  return s;
+}
 
 std::string ParquetTable::CreateStatement() {
-  std::unique_ptr<parquet::ParquetFileReader> reader = parquet::ParquetFileReader::OpenFile(
-      file.data(),
-      true,
-      parquet::default_reader_properties(),
-      metadata);
   std::string text("CREATE TABLE x(");
-  auto schema = reader->metadata()->schema();
+  auto schema = getSchema();
 
   for(auto i = 0; i < schema->num_columns(); i++) {
     auto _col = schema->GetColumnRoot(i);
@@ -52,16 +335,7 @@ std::string ParquetTable::CreateStatement() {
     if(i > 0)
       text += ", ";
 
-    text += "\"";
-    // Horrifically inefficient, but easy to understand.
-    std::string colName = col->name();
-    for(char& c : colName) {
-      if(c == '"')
-        text += "\"\"";
-      else
-        text += c;
-    }
-    text += "\"";
+    appendQuoted(text, col->name());
 
     std::string type;
 
@@ -145,11 +419,477 @@ std::string ParquetTable::CreateStatement() {
     text += " ";
     text += type;
   }
+
+  // Partition values are the text of directory names
+  for(unsigned int i = 0; i < partitionKeys.size(); i++) {
+    for(unsigned int j = 0; j < columnNames.size(); j++) {
+      if(lowerCase(columnNames[j]) == lowerCase(partitionKeys[i])) {
+        std::ostringstream ss;
+        ss << __FILE__ << ":" << __LINE__ << ": partition key " << partitionKeys[i] <<
+          " is also a column of the files";
+        throw std::invalid_argument(ss.str());
+      }
+    }
+    columnNames.push_back(partitionKeys[i]);
+
+    if(columnNames.size() > 1)
+      text += ", ";
+    appendQuoted(text, partitionKeys[i]);
+    text += " TEXT";
+  }
   text +=");";
   return text;
 }
 
-std::shared_ptr<parquet::FileMetaData> ParquetTable::getMetadata() { return metadata; }
+const parquet::SchemaDescriptor* ParquetTable::getSchema() { return files[0].metadata->schema(); }
+int64_t ParquetTable::getNumRows() { return rowGroupStarts.back(); }
+int ParquetTable::getNumRowGroups() { return rowGroupFiles.size(); }
+unsigned int ParquetTable::getNumFiles() { return files.size(); }
+const TableFile& ParquetTable::getTableFile(int file) { return files[file]; }
+int ParquetTable::getRowGroupFile(int group) { return rowGroupFiles[group]; }
+int ParquetTable::getFileRowGroup(int group) { return group - files[rowGroupFiles[group]].firstRowGroup; }
+
+std::unique_ptr<parquet::RowGroupMetaData> ParquetTable::getRowGroupMetadata(int group) {
+  return files[rowGroupFiles[group]].metadata->RowGroup(getFileRowGroup(group));
+}
+
+const std::string* ParquetTable::getPartitionValue(int file, int col) {
+  int key = col - getNumFileColumns();
+  if(files[file].partitionNulls[key])
+    return NULL;
+  return &files[file].partitionValues[key];
+}
+
+bool ParquetTable::hasBloomFilters(int col) {
+  return col < (int)bloomFilters.size() && bloomFilters[col];
+}
+
+std::vector<std::shared_ptr<BloomFilter>> ParquetTable::readBloomFilters(int col) {
+  std::vector<std::shared_ptr<BloomFilter>> rv;
+  if(isPartitionColumn(col) || !BloomFilter::supports(getSchema()->Column(col)->physical_type()))
+    return rv;
+
+  bool any = false;
+  for(unsigned int f = 0; f < files.size(); f++) {
+    const std::vector<std::vector<ColumnChunkLocations>>& locations = getFooter(f).columnChunks;
+    int numRowGroups = files[f].metadata->num_row_groups();
+    for(int i = 0; i < numRowGroups; i++) {
+      std::shared_ptr<BloomFilter> filter;
+      if((int)locations.size() == numRowGroups &&
+          col < (int)locations[i].size() &&
+          locations[i][col].bloomFilter.offset >= 0) {
+        try {
+          filter.reset(new BloomFilter(readBloomFilter(files[f].path, locations[i][col].bloomFilter)));
+          any = true;
+        } catch(std::invalid_argument& e) {
+          // Scan the row group as if it had none
+        }
+      }
+      rv.push_back(filter);
+    }
+  }
+
+  if(!any)
+    rv.clear();
+  return rv;
+}
+
+void ParquetTable::setBloomFilters(int col, std::vector<std::shared_ptr<BloomFilter>> filters) {
+  if(bloomFilters.size() < columnNames.size())
+    bloomFilters.resize(columnNames.size());
+
+  filters.resize(getNumRowGroups());
+  bloomFilters[col].reset(new std::vector<std::shared_ptr<BloomFilter>>(std::move(filters)));
+}
+
+const BloomFilter* ParquetTable::getBloomFilter(int col, int rowGroup) {
+  if(!hasBloomFilters(col))
+    return NULL;
+  return (*bloomFilters[col])[rowGroup].get();
+}
+
+const PageIndex* ParquetTable::getPageIndex(int col, int rowGroup) {
+  if(isPartitionColumn(col))
+    return NULL;
+
+  if(pageIndexes.size() < columnNames.size())
+    pageIndexes.resize(columnNames.size());
+
+  if(!pageIndexes[col]) {
+    std::unique_ptr<std::vector<std::shared_ptr<PageIndex>>> indexes(
+        new std::vector<std::shared_ptr<PageIndex>>(getNumRowGroups()));
+    for(unsigned int i = 0; i < indexes->size(); i++) {
+      int f = rowGroupFiles[i];
+      unsigned int local = getFileRowGroup(i);
+      const std::vector<std::vector<ColumnChunkLocations>>& locations = getFooter(f).columnChunks;
+      if(local >= locations.size() ||
+          col >= (int)locations[local].size() ||
+          locations[local][col].offsetIndex.offset < 0 ||
+          locations[local][col].columnIndex.offset < 0)
+        continue;
+
+      try {
+        (*indexes)[i].reset(new PageIndex(readPageIndex(files[f].path, locations[local][col])));
+      } catch(std::invalid_argument& e) {
+        // Prune the row group's pages by their headers instead
+      }
+    }
+    pageIndexes[col] = std::move(indexes);
+  }
+
+  return (*pageIndexes[col])[rowGroup].get();
+}
+
+const ParquetTableOptions& ParquetTable::getOptions() { return options; }
+
+int64_t ParquetTable::getRowGroupStart(int group) { return rowGroupStarts[group]; }
 
-const std::string& ParquetTable::getFile() { return file; }
+int ParquetTable::findRowGroup(int64_t rowId) {
+  // rowids are 1-based and run on from one file to the next, so row group
+  // i holds rowids
+  // (rowGroupStarts[i], rowGroupStarts[i + 1]]
+  std::vector<int64_t>::const_iterator it =
+    std::upper_bound(rowGroupStarts.begin(), rowGroupStarts.end(), rowId - 1);
+  if(it == rowGroupStarts.begin())
+    return 0;
+  return it - rowGroupStarts.begin() - 1;
+}
 const std::string& ParquetTable::getTableName() { return tableName; }
+
+// Map a string onto a double that preserves the ordering of its first few
+// bytes, so we can reason about the width of a range of strings.
+static double prefixToDouble(const parquet::ByteArray& ba) {
+  double rv = 0;
+  double scale = 1;
+  for(uint32_t i = 0; i < 6; i++) {
+    scale /= 256;
+    if(i < ba.len)
+      rv += ba.ptr[i] * scale;
+  }
+  return rv;
+}
+
+template<typename DType, typename Convert>
+static void minMax(
+    std::shared_ptr<parquet::RowGroupStatistics> _stats,
+    double* lo,
+    double* hi,
+    Convert convert) {
+  parquet::TypedRowGroupStatistics<DType>* stats =
+    (parquet::TypedRowGroupStatistics<DType>*)_stats.get();
+  *lo = convert(stats->min());
+  *hi = convert(stats->max());
+}
+
+template<typename T>
+static double toDouble(const T& v) { return v; }
+
+// Get the range of a column chunk's values as doubles. Returns false if
+// there are no statistics, or we can't map the type onto doubles.
+static bool chunkRange(
+    parquet::ColumnChunkMetaData* chunk,
+    parquet::Type::type physical,
+    double* lo,
+    double* hi) {
+  if(!chunk->is_stats_set())
+    return false;
+
+  std::shared_ptr<parquet::RowGroupStatistics> stats = chunk->statistics();
+  if(!stats->HasMinMax())
+    return false;
+
+  switch(physical) {
+    case parquet::Type::INT32:
+      minMax<parquet::Int32Type>(stats, lo, hi, toDouble<int32_t>);
+      return true;
+    case parquet::Type::INT64:
+      minMax<parquet::Int64Type>(stats, lo, hi, toDouble<int64_t>);
+      return true;
+    case parquet::Type::FLOAT:
+      minMax<parquet::FloatType>(stats, lo, hi, toDouble<float>);
+      return true;
+    case parquet::Type::DOUBLE:
+      minMax<parquet::DoubleType>(stats, lo, hi, toDouble<double>);
+      return true;
+    case parquet::Type::BYTE_ARRAY:
+      minMax<parquet::ByteArrayType>(stats, lo, hi, prefixToDouble);
+      return true;
+    default:
+      return false;
+  }
+}
+
+const ColumnEstimate& ParquetTable::getColumnEstimate(int col) {
+  if(estimates.size() < columnNames.size())
+    estimates.resize(columnNames.size());
+
+  if(estimates[col] != NULL)
+    return *estimates[col];
+
+  if(isPartitionColumn(col)) {
+    estimates[col].reset(new ColumnEstimate(estimatePartitionColumn(col)));
+    return *estimates[col];
+  }
+
+  std::unique_ptr<ColumnEstimate> estimate(new ColumnEstimate());
+  estimate->nullFraction = 0;
+  estimate->pointHitFraction = 1;
+
+  int numRowGroups = getNumRowGroups();
+  int64_t numRows = getNumRows();
+  parquet::Type::type physical = getSchema()->Column(col)->physical_type();
+
+  int64_t nulls = 0;
+  bool haveRanges = numRowGroups > 0;
+  std::vector<double> los, his;
+  for(int i = 0; i < numRowGroups; i++) {
+    std::unique_ptr<parquet::ColumnChunkMetaData> chunk = getRowGroupMetadata(i)->ColumnChunk(col);
+    if(chunk->is_stats_set())
+      nulls += chunk->statistics()->null_count();
+
+    double lo, hi;
+    if(haveRanges && chunkRange(chunk.get(), physical, &lo, &hi)) {
+      los.push_back(lo);
+      his.push_back(hi);
+    } else {
+      haveRanges = false;
+    }
+  }
+
+  if(numRows > 0)
+    estimate->nullFraction = (double)nulls / numRows;
+
+  if(haveRanges) {
+    double lo = *std::min_element(los.begin(), los.end());
+    double hi = *std::max_element(his.begin(), his.end());
+    if(hi > lo) {
+      // The expected number of row groups whose range holds a random point
+      // from [lo, hi]. It's in at least one of them.
+      double groupsHit = 0;
+      for(unsigned int i = 0; i < los.size(); i++)
+        groupsHit += (his[i] - los[i]) / (hi - lo);
+      if(groupsHit < 1)
+        groupsHit = 1;
+      estimate->pointHitFraction = groupsHit / numRowGroups;
+    }
+  }
+
+  estimates[col] = std::move(estimate);
+  return *estimates[col];
+}
+
+// A partition column is constant within each file, so an equality
+// constraint picks out the files with that value.
+ColumnEstimate ParquetTable::estimatePartitionColumn(int col) {
+  ColumnEstimate estimate;
+  estimate.nullFraction = 0;
+  estimate.pointHitFraction = 1;
+
+  int64_t nullRows = 0;
+  std::set<std::string> values;
+  for(unsigned int i = 0; i < files.size(); i++) {
+    const std::string* value = getPartitionValue(i, col);
+    if(value == NULL)
+      nullRows += files[i].metadata->num_rows();
+    else
+      values.insert(*value);
+  }
+
+  if(getNumRows() > 0)
+    estimate.nullFraction = (double)nullRows / getNumRows();
+  if(!values.empty())
+    estimate.pointHitFraction = 1.0 / values.size();
+  return estimate;
+}
+
+// Compare each row group's [min, max] range of a column with the previous
+// row group's; neighbouring ranges may share an endpoint. Returns false if
+// some row group has no min/max statistics.
+template<typename DType, typename T, typename Convert>
+static bool compareRanges(
+    ParquetTable& table,
+    int col,
+    Convert convert,
+    bool* ascending,
+    bool* descending,
+    bool* constant,
+    bool* hasNulls) {
+  *ascending = *descending = *constant = true;
+  *hasNulls = false;
+
+  T lastMin = T(), lastMax = T();
+  for(int i = 0; i < table.getNumRowGroups(); i++) {
+    std::unique_ptr<parquet::ColumnChunkMetaData> chunk = table.getRowGroupMetadata(i)->ColumnChunk(col);
+    if(!chunk->is_stats_set())
+      return false;
+
+    std::shared_ptr<parquet::RowGroupStatistics> _stats = chunk->statistics();
+    if(!_stats->HasMinMax())
+      return false;
+
+    parquet::TypedRowGroupStatistics<DType>* stats =
+      (parquet::TypedRowGroupStatistics<DType>*)_stats.get();
+    T lo = convert(stats->min());
+    T hi = convert(stats->max());
+
+    *hasNulls = *hasNulls || stats->null_count() > 0;
+    *constant = *constant && !(lo < hi);
+    if(i > 0) {
+      *ascending = *ascending && !(lo < lastMax);
+      *descending = *descending && !(lastMin < hi);
+    }
+    lastMin = lo;
+    lastMax = hi;
+  }
+  return true;
+}
+
+const Footer& ParquetTable::getFooter(int file) {
+  return *files[file].footer;
+}
+
+// 1 if every row group says its rows are sorted by the column, ascending,
+// before any other; -1 if they all say descending; otherwise 0.
+int ParquetTable::declaredSortOrder(int col) {
+  int rv = 0;
+  for(unsigned int f = 0; f < files.size(); f++) {
+    const std::vector<std::vector<SortingColumn>>& sortingColumns = getFooter(f).sortingColumns;
+    if((int)sortingColumns.size() != files[f].metadata->num_row_groups())
+      return 0;
+
+    for(unsigned int i = 0; i < sortingColumns.size(); i++) {
+      if(sortingColumns[i].empty() || sortingColumns[i][0].column != col)
+        return 0;
+
+      int order = sortingColumns[i][0].descending ? -1 : 1;
+      if(rv != 0 && order != rv)
+        return 0;
+      rv = order;
+    }
+  }
+  return rv;
+}
+
+// Each file's rows share one value of a partition column, so its order is
+// the order of the files' values. SQLite compares text as memcmp does, like
+// std::string.
+ColumnOrder ParquetTable::orderPartitionColumn(int col) {
+  ColumnOrder order;
+  order.rowGroupOrder = 0;
+  order.rowOrder = 0;
+
+  bool ascending = true, descending = true;
+  const std::string* last = NULL;
+  for(unsigned int i = 0; i < files.size(); i++) {
+    if(files[i].metadata->num_row_groups() == 0)
+      continue;
+
+    // A null between two files with matching values would split their run
+    const std::string* value = getPartitionValue(i, col);
+    if(value == NULL)
+      return order;
+
+    if(last != NULL) {
+      ascending = ascending && !(*value < *last);
+      descending = descending && !(*last < *value);
+    }
+    last = value;
+  }
+
+  order.rowGroupOrder = ascending ? 1 : descending ? -1 : 0;
+  order.rowOrder = order.rowGroupOrder;
+  return order;
+}
+
+const ColumnOrder& ParquetTable::getColumnOrder(int col) {
+  if(orders.size() < columnNames.size())
+    orders.resize(columnNames.size());
+
+  if(orders[col] != NULL)
+    return *orders[col];
+
+  if(isPartitionColumn(col)) {
+    orders[col].reset(new ColumnOrder(orderPartitionColumn(col)));
+    return *orders[col];
+  }
+
+  std::unique_ptr<ColumnOrder> order(new ColumnOrder());
+  order->rowGroupOrder = 0;
+  order->rowOrder = 0;
+
+  const parquet::ColumnDescriptor* descr = getSchema()->Column(col);
+  bool haveRanges = false;
+  // Whether SQLite orders the column's values as the statistics do. NaNs are
+  // null to us, but not to the statistics, so floats only get rowGroupOrder.
+  bool sameOrder = false;
+  bool ascending, descending, constant, hasNulls;
+  switch(descr->physical_type()) {
+    case parquet::Type::INT32:
+      haveRanges = compareRanges<parquet::Int32Type, int64_t>(*this, col,
+          [](int32_t v) { return (int64_t)v; }, &ascending, &descending, &constant, &hasNulls);
+      sameOrder = true;
+      break;
+    case parquet::Type::INT64:
+      haveRanges = compareRanges<parquet::Int64Type, int64_t>(*this, col,
+          [](int64_t v) { return v; }, &ascending, &descending, &constant, &hasNulls);
+      sameOrder = true;
+      break;
+    case parquet::Type::FLOAT:
+      haveRanges = compareRanges<parquet::FloatType, double>(*this, col,
+          [](float v) { return (double)v; }, &ascending, &descending, &constant, &hasNulls);
+      break;
+    case parquet::Type::DOUBLE:
+      haveRanges = compareRanges<parquet::DoubleType, double>(*this, col,
+          [](double v) { return v; }, &ascending, &descending, &constant, &hasNulls);
+      break;
+    case parquet::Type::BYTE_ARRAY:
+      if(descr->logical_type() == parquet::LogicalType::UTF8) {
+        haveRanges = compareRanges<parquet::ByteArrayType, std::string>(*this, col,
+            [](const parquet::ByteArray& v) { return std::string((const char*)v.ptr, v.len); },
+            &ascending, &descending, &constant, &hasNulls);
+        sameOrder = true;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if(haveRanges) {
+    order->rowGroupOrder = ascending ? 1 : descending ? -1 : 0;
+
+    // SQLite sorts nulls first, so we'd have to know where they are
+    if(sameOrder && !hasNulls) {
+      // A row group whose values are all the same is in any order
+      int withinRowGroups = constant ? order->rowGroupOrder : declaredSortOrder(col);
+      if((withinRowGroups == 1 && ascending) || (withinRowGroups == -1 && descending))
+        order->rowOrder = withinRowGroups;
+    }
+  }
+
+  orders[col] = std::move(order);
+  return *orders[col];
+}
+
+const TableFingerprint& ParquetTable::getFingerprint() {
+  if(fingerprint != NULL)
+    return *fingerprint;
+
+  std::unique_ptr<TableFingerprint> rv(new TableFingerprint());
+  rv->size = 0;
+  rv->mtime = 0;
+  std::string hashes;
+  for(unsigned int i = 0; i < files.size(); i++) {
+    const FileIdentity& identity = files[i].identity;
+    int64_t mtime = (int64_t)identity.mtimeSec * 1000000000 + identity.mtimeNsec;
+    rv->size += identity.size;
+    rv->mtime = std::max(rv->mtime, mtime);
+
+    uint64_t hash = getFooter(i).hash;
+    hashes.append(files[i].path);
+    hashes.append((const char*)&hash, sizeof(hash));
+  }
+  rv->footerHash = (int64_t)xxHash64(hashes.data(), hashes.size());
+
+  fingerprint = std::move(rv);
+  return *fingerprint;
+}
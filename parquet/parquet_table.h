@@ -4,22 +4,148 @@
 #include <vector>
 #include <string>
 #include "parquet/api/reader.h"
+#include "parquet_bloom.h"
+#include "parquet_footer.h"
+#include "parquet_reader_pool.h"
+
+// Options that may follow the path when creating a table, eg
+// CREATE VIRTUAL TABLE t USING parquet('file.parquet', 'mmap=0')
+struct ParquetTableOptions {
+  // Read the file through a memory mapping rather than with pread
+  bool mmap;
+  // Row groups ahead of the current one that worker threads decode in
+  // parallel. 1 scans on SQLite's thread alone.
+  int threads;
+
+  ParquetTableOptions();
+
+  // Apply one 'key=value' argument. Throws if it isn't understood.
+  void parse(const std::string& arg);
+};
+
+// What the file's metadata says about a column, for estimating how
+// selective constraints on it are.
+struct ColumnEstimate {
+  // Fraction of all rows that are null
+  double nullFraction;
+  // Fraction of row groups that an equality constraint can't rule out from
+  // their min/max statistics, for a value chosen at random from the column's
+  // range. Wide, overlapping ranges push this to 1; a sorted column
+  // approaches 1/numRowGroups.
+  double pointHitFraction;
+};
+
+// How a column's values are ordered through the file, judging by its row
+// groups' statistics and the sort order their writer declared.
+struct ColumnOrder {
+  // 1 if each row group's values are all >= the previous row group's, -1 if
+  // they're all <=, 0 if neither or some row group lacks statistics. Nulls
+  // aside. Either way, the row groups that can satisfy a range constraint on
+  // the column are consecutive.
+  int rowGroupOrder;
+  // 1 if a scan returns the column's values in ascending order, as SQLite
+  // would sort them, -1 if in descending order, 0 if we can't tell.
+  int rowOrder;
+};
+
+// One of the files a table reads. A table made from a directory or a glob
+// reads every Parquet file in it, as if they were one file whose row groups
+// are each file's in turn, sorted by path.
+struct TableFile {
+  std::string path;
+  // The version of the file that metadata was read from
+  FileIdentity identity;
+  std::shared_ptr<parquet::FileMetaData> metadata;
+  // The table's number for the file's first row group
+  int firstRowGroup;
+  // Indexed by partition key, in the order the table's columns are; a
+  // value is meaningless if its null flag is set
+  std::vector<std::string> partitionValues;
+  std::vector<unsigned char> partitionNulls;
+  // Read along with metadata; empty if it couldn't be
+  std::shared_ptr<const Footer> footer;
+};
+
+// Tells the version of a table's files apart from any other, so what was
+// learnt about one isn't applied to another. Over all the files, in order.
+struct TableFingerprint {
+  int64_t size;
+  // Of the most recently modified file, in nanoseconds since the epoch
+  int64_t mtime;
+  int64_t footerHash;
+};
 
 class ParquetTable {
   std::string file;
   std::string tableName;
+  ParquetTableOptions options;
+  // The files' columns, then the partition keys, from key=value directories
   std::vector<std::string> columnNames;
-  std::shared_ptr<parquet::FileMetaData> metadata;
+  std::vector<std::string> partitionKeys;
+  std::vector<TableFile> files;
+  // Indexed by row group: the file holding it
+  std::vector<int> rowGroupFiles;
+  // Indexed by row group: the number of rows before it. One longer than
+  // the number of row groups, ending with the number of rows in the table.
+  std::vector<int64_t> rowGroupStarts;
+  // Computed on first use; indexed by column
+  std::vector<std::unique_ptr<ColumnEstimate>> estimates;
+  std::vector<std::unique_ptr<ColumnOrder>> orders;
+  // Computed on first use
+  std::unique_ptr<TableFingerprint> fingerprint;
+  void addFile(const std::string& path, const std::vector<std::pair<std::string, std::string>>& partitions);
+  const Footer& getFooter(int file);
+  int declaredSortOrder(int col);
+  ColumnEstimate estimatePartitionColumn(int col);
+  ColumnOrder orderPartitionColumn(int col);
+  // Indexed by column, then row group, with NULL for column chunks that
+  // have no filter. A column's entry is NULL until its filters are loaded.
+  std::vector<std::unique_ptr<std::vector<std::shared_ptr<BloomFilter>>>> bloomFilters;
+  // Likewise for page indexes, read from the file on first use
+  std::vector<std::unique_ptr<std::vector<std::shared_ptr<PageIndex>>>> pageIndexes;
 
 
 public:
-  ParquetTable(std::string file, std::string tableName);
+  // file is a Parquet file, a directory to read every Parquet file under,
+  // or a glob matching files or directories.
+  ParquetTable(std::string file, std::string tableName, ParquetTableOptions options);
   std::string CreateStatement();
   std::string columnName(int idx);
   unsigned int getNumColumns();
-  std::shared_ptr<parquet::FileMetaData> getMetadata();
-  const std::string& getFile();
+  // The columns that come from the files; partition keys follow them
+  unsigned int getNumFileColumns();
+  bool isPartitionColumn(int col);
+  // The files' schema, which they all share
+  const parquet::SchemaDescriptor* getSchema();
+  int64_t getNumRows();
+  int getNumRowGroups();
+  unsigned int getNumFiles();
+  const TableFile& getTableFile(int file);
+  // The file holding a row group, and the row group's number within it
+  int getRowGroupFile(int group);
+  int getFileRowGroup(int group);
+  std::unique_ptr<parquet::RowGroupMetaData> getRowGroupMetadata(int group);
+  // A partition column's value for a file's rows, or NULL if it's null
+  const std::string* getPartitionValue(int file, int col);
+  const ColumnEstimate& getColumnEstimate(int col);
+  const ColumnOrder& getColumnOrder(int col);
+  int64_t getRowGroupStart(int group);
+  // The row group holding the given rowid, or the number of row groups if
+  // it's past the end of the file
+  int findRowGroup(int64_t rowId);
+  bool hasBloomFilters(int col);
+  // The column's bloom filters from the file, by row group, or an empty
+  // vector if it has none we can use
+  std::vector<std::shared_ptr<BloomFilter>> readBloomFilters(int col);
+  void setBloomFilters(int col, std::vector<std::shared_ptr<BloomFilter>> filters);
+  // NULL if the column chunk has no bloom filter, or its column's haven't
+  // been loaded
+  const BloomFilter* getBloomFilter(int col, int rowGroup);
+  // NULL if the column chunk has no page index
+  const PageIndex* getPageIndex(int col, int rowGroup);
+  const ParquetTableOptions& getOptions();
   const std::string& getTableName();
+  const TableFingerprint& getFingerprint();
 };
 
 #endif
@@ -0,0 +1,2 @@
+select parquet_config('max_open_files', 1), count(*) from no_nulls1 a, no_nulls2 b where a.rowid = b.rowid and a.int64_4 = b.int64_4
+1|99
@@ -0,0 +1,3 @@
+select int8_1 from nulls1 where int8_1 > 48.5
+50
+49
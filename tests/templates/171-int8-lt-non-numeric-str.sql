@@ -0,0 +1,2 @@
+select count(*) from nulls1 where int8_1 < 'abc'
+50
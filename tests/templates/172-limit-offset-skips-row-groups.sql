@@ -0,0 +1,4 @@
+select rowid from no_nulls2 limit 3 offset 18
+19
+20
+21
@@ -0,0 +1,3 @@
+select rowid from no_nulls2 where rowid > 10 limit 2 offset 5
+16
+17
@@ -0,0 +1,4 @@
+select rowid from no_nulls2 where rowid in (95, 5, 50, 5, 1000)
+5
+50
+95
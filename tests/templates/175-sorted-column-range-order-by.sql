@@ -0,0 +1,5 @@
+select int16_2 from no_nulls where int16_2 > 4600 order by int16_2 desc
+5000
+4900
+4800
+4700
@@ -0,0 +1,4 @@
+select rowid, int8_1 from no_nulls where rowid between 45 and 47
+45|6
+46|5
+47|4
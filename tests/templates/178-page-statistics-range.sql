@@ -0,0 +1,3 @@
+select rowid, int16_2 from no_nulls where int16_2 >= 4800 and int8_1 < 50
+2|4900
+3|4800
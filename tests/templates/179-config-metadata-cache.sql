@@ -0,0 +1,2 @@
+select parquet_config('metadata_cache_bytes', 0), count(*) from no_nulls1 where int8_1 = 7
+0|1
@@ -0,0 +1,2 @@
+select min(string_7), max(string_7), count(distinct string_8), group_concat(string_7, '') like '0123%' from no_nulls
+0|98|99|1
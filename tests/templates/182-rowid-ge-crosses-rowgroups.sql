@@ -0,0 +1,4 @@
+select rowid, int8_1 from no_nulls where rowid >= 10 limit 3
+10|41
+11|40
+12|39